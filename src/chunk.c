@@ -10,12 +10,16 @@ void initChunk(Chunk* chunk) {
     chunk->code = NULL;
     chunk->lines = NULL;
     initValueArray(&chunk->constants);
+    chunk->cacheCount = 0;
+    chunk->cacheCapacity = 0;
+    chunk->caches = NULL;
 }
 
 void freeChunk(Chunk* chunk) {
     FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
     FREE_ARRAY(int, chunk->lines, chunk->capacity);
     freeValueArray(&chunk->constants);
+    FREE_ARRAY(InlineCache, chunk->caches, chunk->cacheCapacity);
     initChunk(chunk);
 }
 
@@ -38,3 +42,19 @@ int addConstant(Chunk* chunk, Value value) {
     pop();
     return chunk->constants.count - 1;
 }
+
+int addInlineCache(Chunk* chunk, ObjString* name) {
+    push(OBJ_VAL(name));
+    if (chunk->cacheCapacity < chunk->cacheCount + 1) {
+        int oldCapacity = chunk->cacheCapacity;
+        chunk->cacheCapacity = GROW_CAPACITY(oldCapacity);
+        chunk->caches = GROW_ARRAY(chunk->caches, InlineCache, oldCapacity, chunk->cacheCapacity);
+    }
+    pop();
+
+    InlineCache* cache = &chunk->caches[chunk->cacheCount];
+    cache->name = name;
+    cache->shape = NULL;
+    cache->index = -1;
+    return chunk->cacheCount++;
+}
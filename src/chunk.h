@@ -37,12 +37,23 @@ typedef enum {
     OP_CLOSE_UPVALUE,
     OP_BUILD_LIST,
     OP_BUILD_MAP,
+    OP_BUILD_STRING,
     OP_INDEX_SUBSCR,
     OP_STORE_SUBSCR,
+    OP_GET_FIELD,
+    OP_SET_FIELD,
     OP_WIDE,
     OP_RETURN,
 } OpCode;
 
+// Remembers the shape of the last map a dot access saw and where the field
+// lived in it. A map with the same shape keeps the field in the same entry.
+typedef struct {
+    ObjString* name;
+    ObjShape* shape;
+    int index;
+} InlineCache;
+
 // TODO Lines is O(Opcodes). Can be optimized to O(Lines)
 typedef struct {
     int count;
@@ -50,11 +61,15 @@ typedef struct {
     uint8_t* code;
     int* lines;
     ValueArray constants;
+    int cacheCount;
+    int cacheCapacity;
+    InlineCache* caches;
 } Chunk;
 
 void initChunk(Chunk* chunk);
 void freeChunk(Chunk* chunk);
 void writeChunk(Chunk* chunk, uint8_t byte, int line);
 int addConstant(Chunk* chunk, Value value);
+int addInlineCache(Chunk* chunk, ObjString* name);
 
 #endif
\ No newline at end of file
@@ -381,14 +381,22 @@ static void subscript(bool canAssign) {
 
 static void dot(bool canAssign) {
     consume(TOKEN_IDENTIFIER, "Expect identifier after '.'.");
-    emitConstant(OBJ_VAL(copyString(parser.previous.start, parser.previous.length)));
+
+    // Every dot access site gets its own inline cache
+    ObjString* name = copyString(parser.previous.start, parser.previous.length);
+    int cache = addInlineCache(currentChunk(), name);
+    if (cache > UINT16_MAX) {
+        error("Too many field accesses in one chunk.");
+    }
 
     if (canAssign && match(TOKEN_EQUAL)) {
         expression();
-        emitByte(OP_STORE_SUBSCR);
+        emitByte(OP_SET_FIELD);
     } else {
-        emitByte(OP_INDEX_SUBSCR);
+        emitByte(OP_GET_FIELD);
     }
+    emitByte((uint8_t)(cache >> 8));
+    emitByte((uint8_t)cache);
 }
 
 static void literal(bool canAssign) {
@@ -732,21 +740,18 @@ static void or_(bool canAssign) {
     patchJump(endJump);
 }
 
-static void basicString(bool canAssign) {
-    // Basic strings can have escape sequences.
-    // Need to scan token chars and build up new string with converted
-    // escape sequences.
-    int tokenLen = parser.previous.length - 2;
+// Emits the string between start and start + length with its escape
+// sequences converted.
+static void escapedString(const char* start, int length) {
+    char* new = ALLOCATE(char, length);
     int realLen = 0;
 
-    char* new = ALLOCATE(char, tokenLen);
-
-    for (int i = 1; i < tokenLen + 1; ++i) {
-        char c = parser.previous.start[i];
+    for (int i = 0; i < length; ++i) {
+        char c = start[i];
 
         // Can't have escape sequence with only 1 char left
-        if (i < tokenLen && c == '\\') {
-            char next = parser.previous.start[++i];
+        if (i < length - 1 && c == '\\') {
+            char next = start[++i];
             switch (next) {
                 case '\n':
                     break;
@@ -759,6 +764,9 @@ static void basicString(bool canAssign) {
                 case '\"':
                     new[realLen++] = '\"';
                     break;
+                case '$':
+                    new[realLen++] = '$';
+                    break;
                 case 'n':
                     new[realLen++] = '\n';
                     break;
@@ -774,53 +782,50 @@ static void basicString(bool canAssign) {
         new[realLen++] = c;
     }
     emitConstant(OBJ_VAL(copyString(new, realLen)));
-    FREE(char, new);
+    FREE_ARRAY(char, new, length);
 }
 
-// TODO support actual templating
-static void templateString(bool canAssign) {
-    // Template strings can have escape sequences.
-    // Need to scan token chars and build up new string with converted
-    // escape sequences.
-    int tokenLen = parser.previous.length - 2;
-    int realLen = 0;
-
-    char* new = ALLOCATE(char, tokenLen);
-
-    for (int i = 1; i < tokenLen + 1; ++i) {
-        char c = parser.previous.start[i];
+static void basicString(bool canAssign) {
+    // Basic strings can have escape sequences.
+    escapedString(parser.previous.start + 1, parser.previous.length - 2);
+}
 
-        // Can't have escape sequence with only 1 char left
-        if (i < tokenLen && c == '\\') {
-            char next = parser.previous.start[++i];
-            switch (next) {
-                case '\n':
-                    break;
-                case '\\':
-                    new[realLen++] = '\\';
-                    break;
-                case '\'':
-                    new[realLen++] = '\'';
-                    break;
-                case '\"':
-                    new[realLen++] = '\"';
-                    break;
-                case 'n':
-                    new[realLen++] = '\n';
-                    break;
-                case 't':
-                    new[realLen++] = '\t';
-                    break;
-                default:
-                    break;
-            }
-            continue;
+static void templateString(bool canAssign) {
+    // A template string without any "${...}" is a plain string constant.
+    escapedString(parser.previous.start + 1, parser.previous.length - 2);
+}
+
+static void interpolation(bool canAssign) {
+    // "a${x}b${y}c" arrives as the tokens "a${, x, }b${, y and }c". Every
+    // piece is pushed and OP_BUILD_STRING joins them into one new string.
+    int partCount = 0;
+    do {
+        // Text between the opening '"' or '}' and the "${"
+        if (parser.previous.length > 3) {
+            escapedString(parser.previous.start + 1, parser.previous.length - 3);
+            partCount++;
+        }
+        expression();
+        partCount++;
+        if (partCount >= UINT16_MAX) {
+            error("Cannot have more than 65535 parts in a template string.");
         }
+    } while (match(TOKEN_INTERPOLATION));
 
-        new[realLen++] = c;
+    consume(TOKEN_TEMPLATE_STRING, "Expect '}' after template string expression.");
+    if (parser.previous.length > 2) {
+        escapedString(parser.previous.start + 1, parser.previous.length - 2);
+        partCount++;
+    }
+
+    if (partCount < 256) {
+        emitByte(OP_BUILD_STRING);
+        emitByte(partCount);
+    } else {
+        emitBytes(OP_WIDE, OP_BUILD_STRING);
+        emitByte((uint8_t)(partCount >> 8));
+        emitByte((uint8_t)partCount);
     }
-    emitConstant(OBJ_VAL(copyString(new, realLen)));
-    FREE(char, new);
 }
 
 static void rawString(bool canAssign) {
@@ -1022,6 +1027,7 @@ ParseRule rules[] = {
     { variable,        NULL,       PREC_NONE },        // TOKEN_IDENTIFIER
     { number,          NULL,       PREC_NONE },        // TOKEN_NUMBER
     { templateString,  NULL,       PREC_NONE },        // TOKEN_TEMPLATE_STRING
+    { interpolation,   NULL,       PREC_NONE },        // TOKEN_INTERPOLATION
     { rawString,       NULL,       PREC_NONE },        // TOKEN_RAW_STRING
     { NULL,            and_,       PREC_AND },         // TOKEN_AND
     { NULL,            NULL,       PREC_NONE },        // TOKEN_BREAK
@@ -0,0 +1,1631 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compress.h"
+#include "file.h"
+#include "hash.h"
+#include "memory.h"
+#include "object.h"
+#include "vm.h"
+
+// Problems, as the object of "found" in error messages
+static const char truncatedData[] = "truncated data";
+static const char trailingData[] = "data after the end of the stream";
+static const char tooBig[] = "a result too big for a string";
+static const char writeFailure[] = "a failed write";
+
+static uint16_t readLE16(const uint8_t* bytes) {
+    return (uint16_t)(bytes[0] | bytes[1] << 8);
+}
+
+static uint32_t readLE32(const uint8_t* bytes) {
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 |
+           (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static uint64_t readLE64(const uint8_t* bytes) {
+    return (uint64_t)readLE32(bytes) | (uint64_t)readLE32(bytes + 4) << 32;
+}
+
+static void writeLE16(uint8_t* bytes, uint16_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+static void writeLE32(uint8_t* bytes, uint32_t value) {
+    for (int i = 0; i < 4; i++) bytes[i] = (uint8_t)(value >> (i * 8));
+}
+
+static void writeLE64(uint8_t* bytes, uint64_t value) {
+    for (int i = 0; i < 8; i++) bytes[i] = (uint8_t)(value >> (i * 8));
+}
+
+// Decoders keep this much output around for matches to copy from
+#define HISTORY_SIZE 65536
+#define FILE_WINDOW ((4 << 20) + HISTORY_SIZE)
+
+typedef enum {
+    SUM_NONE,
+    SUM_CRC32,
+    SUM_XXHASH32,
+} SumKind;
+
+// Where encoders and decoders write. In memory the buffer grows if the first
+// guess at its size was short, and decoding goes straight into the result
+// string when the data says how big it will be. For a file, what's been
+// written is drained to it whenever the window fills, keeping the last keep
+// bytes as history.
+typedef struct {
+    uint8_t* start;
+    uint8_t* next;
+    uint8_t* end;
+    uint8_t* flushed;   // Everything before this has been written to the file
+    uint8_t* summed;    // Everything before this has been checksummed
+    size_t capacity;
+    size_t drained;     // Bytes written to the file so far
+    size_t keep;
+    int fd;             // -1 for memory
+    ObjString* string;  // The string being written into, if any
+    const char* problem;
+    SumKind sum;
+    uint32_t crc;
+    Xxhash32 xxhash;
+} Sink;
+
+static void initSink(Sink* out, uint8_t* start, size_t capacity, int fd, size_t keep) {
+    out->start = out->next = out->flushed = out->summed = start;
+    out->end = start + capacity;
+    out->capacity = capacity;
+    out->drained = 0;
+    out->keep = keep;
+    out->fd = fd;
+    out->string = NULL;
+    out->problem = NULL;
+    out->sum = SUM_NONE;
+}
+
+static void freeSink(Sink* out) {
+    if (out->string == NULL) FREE_ARRAY(uint8_t, out->start, out->capacity);
+}
+
+static size_t sinkSize(Sink* out) {
+    return out->drained + (size_t)(out->next - out->flushed);
+}
+
+static void sumSink(Sink* out) {
+    const char* chars = (const char*)out->summed;
+    size_t length = (size_t)(out->next - out->summed);
+    if (out->sum == SUM_CRC32) {
+        out->crc = updateCrc32(out->crc, chars, length);
+    } else if (out->sum == SUM_XXHASH32) {
+        updateXxhash32(&out->xxhash, chars, length);
+    }
+    out->summed = out->next;
+}
+
+static void startSum(Sink* out, SumKind sum) {
+    sumSink(out);
+    out->sum = sum;
+    out->crc = 0;
+    startXxhash32(&out->xxhash, 0);
+}
+
+static uint32_t finishSum(Sink* out) {
+    sumSink(out);
+    return out->sum == SUM_CRC32 ? out->crc : finishXxhash32(&out->xxhash);
+}
+
+static bool drainSink(Sink* out) {
+    sumSink(out);
+    size_t count = (size_t)(out->next - out->flushed);
+    if (!writeDescriptor(out->fd, (const char*)out->flushed, count)) {
+        out->problem = writeFailure;
+        return false;
+    }
+    out->drained += count;
+    size_t used = (size_t)(out->next - out->start);
+    size_t kept = used < out->keep ? used : out->keep;
+    memmove(out->start, out->next - kept, kept);
+    out->next = out->flushed = out->summed = out->start + kept;
+    return true;
+}
+
+static bool growSink(Sink* out, size_t count) {
+    size_t used = (size_t)(out->next - out->start);
+    size_t capacity = out->capacity * 2;
+    if (capacity < used + count) capacity = used + count;
+    if (out->fd < 0 && capacity > INT32_MAX) {
+        if (used + count > INT32_MAX) {
+            out->problem = tooBig;
+            return false;
+        }
+        capacity = INT32_MAX;
+    }
+    uint8_t* start;
+    if (out->string != NULL) {
+        // The data was bigger than it said, so carry on in a buffer
+        start = ALLOCATE(uint8_t, capacity);
+        memcpy(start, out->start, used);
+        out->string = NULL;
+    } else {
+        start = GROW_ARRAY(out->start, uint8_t, out->capacity, capacity);
+    }
+    out->next = start + used;
+    out->flushed = start + (out->flushed - out->start);
+    out->summed = start + (out->summed - out->start);
+    out->start = start;
+    out->end = start + capacity;
+    out->capacity = capacity;
+    return true;
+}
+
+static bool extendSink(Sink* out, size_t count) {
+    if (out->fd >= 0) {
+        if (!drainSink(out)) return false;
+        if ((size_t)(out->end - out->next) >= count) return true;
+    }
+    return growSink(out, count);
+}
+
+// Makes sure count more bytes fit, draining or growing the buffer if not.
+// Moves the buffer, so pointers into it need reloading afterwards.
+static inline bool makeRoom(Sink* out, size_t count) {
+    return (size_t)(out->end - out->next) >= count || extendSink(out, count);
+}
+
+// Copies a match from distance bytes back, which may overlap what it writes.
+// Given 16 bytes of room to spare it copies whole words, overshooting the end.
+static inline void copyMatch(uint8_t* next, size_t distance, size_t length, size_t room) {
+    const uint8_t* match = next - distance;
+    uint8_t* end = next + length;
+    if (room < length + 16) {
+        while (next < end) *next++ = *match++;
+    } else if (distance >= 16) {
+        do {
+            memcpy(next, match, 16);
+            next += 16;
+            match += 16;
+        } while (next < end);
+    } else if (distance >= 8) {
+        do {
+            memcpy(next, match, 8);
+            next += 8;
+            match += 8;
+        } while (next < end);
+    } else if (distance == 1) {
+        memset(next, *match, length);
+    } else {
+        while (next < end) *next++ = *match++;
+    }
+}
+
+// Counts how many bytes match starting at bytes and match, stopping at limit.
+static size_t countMatch(const uint8_t* match, const uint8_t* bytes, const uint8_t* limit) {
+    const uint8_t* start = bytes;
+    while (limit - bytes >= 8) {
+        uint64_t difference = readLE64(match) ^ readLE64(bytes);
+        if (difference != 0) return (size_t)(bytes - start) + (__builtin_ctzll(difference) >> 3);
+        bytes += 8;
+        match += 8;
+    }
+    while (bytes < limit && *bytes == *match) {
+        bytes++;
+        match++;
+    }
+    return (size_t)(bytes - start);
+}
+
+// Frames made here hold independent 4MB blocks and carry the content size
+// and a checksum of the content. Reading also handles linked blocks, block
+// checksums and skippable frames, but not dictionaries.
+
+#define LZ4_MAGIC 0x184D2204
+#define LZ4_HEADER_SIZE 15
+#define LZ4_BLOCK_SIZE (4 << 20)
+#define LZ4_HASH_BITS 16
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5     // A block always ends in this many literals
+#define LZ4_MATCH_LIMIT 12      // and no match starts in its last 12 bytes
+#define LZ4_MAX_DISTANCE 65535
+#define LZ4_SKIP_TRIGGER 6      // Step further after each 64 misses in a row
+
+static const char lz4NotFrame[] = "data that isn't an LZ4 frame";
+static const char lz4BadHeader[] = "a corrupt LZ4 frame header";
+static const char lz4Corrupt[] = "a corrupt LZ4 block";
+
+static size_t lz4BlockBound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+static uint32_t lz4Hash(const uint8_t* bytes) {
+    return (readLE32(bytes) * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+static uint8_t lz4HeaderChecksum(const uint8_t* descriptor, size_t length) {
+    Xxhash32 xxhash;
+    startXxhash32(&xxhash, 0);
+    updateXxhash32(&xxhash, (const char*)descriptor, length);
+    return (uint8_t)(finishXxhash32(&xxhash) >> 8);
+}
+
+// Writes what's left of a length that didn't fit in its token's 4 bits.
+static uint8_t* writeLz4Length(uint8_t* next, size_t length) {
+    for (; length >= 255; length -= 255) *next++ = 255;
+    *next++ = (uint8_t)length;
+    return next;
+}
+
+// Compresses a block into next, which has room for lz4BlockBound(length), and
+// returns where the output ends. The hash table maps 4 byte sequences to the
+// last place they were seen and is reset first.
+static uint8_t* lz4CompressBlock(uint32_t* table, const uint8_t* in, size_t length,
+                                 uint8_t* next) {
+    const uint8_t* bytes = in;
+    const uint8_t* anchor = in;
+    const uint8_t* end = in + length;
+    memset(table, 0, sizeof(uint32_t) << LZ4_HASH_BITS);
+
+    if (length > LZ4_MATCH_LIMIT) {
+        const uint8_t* matchLimit = end - LZ4_MATCH_LIMIT;
+        const uint8_t* matchEnd = end - LZ4_LAST_LITERALS;
+        bytes++;
+        for (;;) {
+            // Probe each position until four bytes match, striding further
+            // through data that doesn't compress
+            const uint8_t* match;
+            const uint8_t* forward = bytes;
+            int misses = 1 << LZ4_SKIP_TRIGGER;
+            do {
+                bytes = forward;
+                forward += misses++ >> LZ4_SKIP_TRIGGER;
+                if (forward > matchLimit) goto lastLiterals;
+                uint32_t hash = lz4Hash(bytes);
+                match = in + table[hash];
+                table[hash] = (uint32_t)(bytes - in);
+            } while (bytes - match > LZ4_MAX_DISTANCE || readLE32(match) != readLE32(bytes));
+
+            while (bytes > anchor && match > in && bytes[-1] == match[-1]) {
+                bytes--;
+                match--;
+            }
+
+            size_t literals = (size_t)(bytes - anchor);
+            uint8_t* token = next++;
+            if (literals >= 15) {
+                *token = 15 << 4;
+                next = writeLz4Length(next, literals - 15);
+            } else {
+                *token = (uint8_t)(literals << 4);
+            }
+            memcpy(next, anchor, literals);
+            next += literals;
+
+            // Matches can follow each other with no literals between
+            for (;;) {
+                writeLE16(next, (uint16_t)(bytes - match));
+                next += 2;
+                size_t matchLength =
+                    countMatch(match + LZ4_MIN_MATCH, bytes + LZ4_MIN_MATCH, matchEnd);
+                bytes += LZ4_MIN_MATCH + matchLength;
+                if (matchLength >= 15) {
+                    *token += 15;
+                    next = writeLz4Length(next, matchLength - 15);
+                } else {
+                    *token += (uint8_t)matchLength;
+                }
+                anchor = bytes;
+                if (bytes > matchLimit) goto lastLiterals;
+
+                table[lz4Hash(bytes - 2)] = (uint32_t)(bytes - 2 - in);
+                uint32_t hash = lz4Hash(bytes);
+                match = in + table[hash];
+                table[hash] = (uint32_t)(bytes - in);
+                if (bytes - match > LZ4_MAX_DISTANCE || readLE32(match) != readLE32(bytes)) break;
+                token = next++;
+                *token = 0;
+            }
+            bytes++;
+        }
+    }
+
+lastLiterals: {
+        size_t literals = (size_t)(end - anchor);
+        if (literals >= 15) {
+            *next++ = 15 << 4;
+            next = writeLz4Length(next, literals - 15);
+        } else {
+            *next++ = (uint8_t)(literals << 4);
+        }
+        memcpy(next, anchor, literals);
+        return next + literals;
+    }
+}
+
+static const char* lz4Compress(const uint8_t* in, size_t length, Sink* out) {
+    if (!makeRoom(out, LZ4_HEADER_SIZE)) return out->problem;
+    uint8_t* header = out->next;
+    writeLE32(header, LZ4_MAGIC);
+    header[4] = 0x40 | 0x20 | 0x08 | 0x04;  // Version 1, independent blocks, size, checksum
+    header[5] = 7 << 4;                     // 4MB blocks
+    writeLE64(header + 6, length);
+    header[14] = lz4HeaderChecksum(header + 4, 10);
+    out->next += LZ4_HEADER_SIZE;
+
+    uint32_t* table = ALLOCATE(uint32_t, 1 << LZ4_HASH_BITS);
+    for (size_t offset = 0; offset < length; offset += LZ4_BLOCK_SIZE) {
+        size_t size = length - offset < LZ4_BLOCK_SIZE ? length - offset : LZ4_BLOCK_SIZE;
+        if (!makeRoom(out, 4 + lz4BlockBound(size))) {
+            FREE_ARRAY(uint32_t, table, 1 << LZ4_HASH_BITS);
+            return out->problem;
+        }
+        uint8_t* block = out->next + 4;
+        size_t compressed = (size_t)(lz4CompressBlock(table, in + offset, size, block) - block);
+        if (compressed >= size) {
+            // Incompressible blocks are stored as they are
+            memcpy(block, in + offset, size);
+            writeLE32(out->next, (uint32_t)size | 0x80000000);
+            compressed = size;
+        } else {
+            writeLE32(out->next, (uint32_t)compressed);
+        }
+        out->next = block + compressed;
+    }
+    FREE_ARRAY(uint32_t, table, 1 << LZ4_HASH_BITS);
+
+    if (!makeRoom(out, 8)) return out->problem;
+    Xxhash32 xxhash;
+    startXxhash32(&xxhash, 0);
+    updateXxhash32(&xxhash, (const char*)in, length);
+    writeLE32(out->next, 0);
+    writeLE32(out->next + 4, finishXxhash32(&xxhash));
+    out->next += 8;
+    return NULL;
+}
+
+// Reads the rest of a length that didn't fit in its token's 4 bits.
+static const uint8_t* readLz4Length(const uint8_t* bytes, const uint8_t* end, size_t* length) {
+    uint8_t byte;
+    do {
+        if (bytes >= end) return NULL;
+        byte = *bytes++;
+        *length += byte;
+    } while (byte == 255);
+    return bytes;
+}
+
+// Decodes a block of at most maxSize bytes. Matches in independent blocks
+// may only reach back to the block's start.
+static const char* lz4DecodeBlock(const uint8_t* bytes, size_t length, Sink* out,
+                                  size_t maxSize, bool independent) {
+    const uint8_t* end = bytes + length;
+    size_t produced = 0;
+    for (;;) {
+        if (bytes >= end) return lz4Corrupt;
+        uint8_t token = *bytes++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && (bytes = readLz4Length(bytes, end, &literals)) == NULL) {
+            return lz4Corrupt;
+        }
+        if (literals > (size_t)(end - bytes) || literals > maxSize - produced) return lz4Corrupt;
+        if (!makeRoom(out, literals)) return out->problem;
+        if (literals <= 16 && end - bytes >= 16 && out->end - out->next >= 16) {
+            memcpy(out->next, bytes, 16);
+        } else {
+            memcpy(out->next, bytes, literals);
+        }
+        out->next += literals;
+        bytes += literals;
+        produced += literals;
+        // The last sequence is only literals
+        if (bytes == end) return NULL;
+
+        if (end - bytes < 2) return lz4Corrupt;
+        size_t distance = readLE16(bytes);
+        bytes += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && (bytes = readLz4Length(bytes, end, &matchLength)) == NULL) {
+            return lz4Corrupt;
+        }
+        matchLength += LZ4_MIN_MATCH;
+        if (matchLength > maxSize - produced) return lz4Corrupt;
+        if (!makeRoom(out, matchLength)) return out->problem;
+        size_t reach = independent ? produced : (size_t)(out->next - out->start);
+        if (distance == 0 || distance > reach) return lz4Corrupt;
+        copyMatch(out->next, distance, matchLength, (size_t)(out->end - out->next));
+        out->next += matchLength;
+        produced += matchLength;
+    }
+}
+
+static const char* lz4Decompress(const uint8_t* in, size_t length, Sink* out) {
+    const uint8_t* bytes = in;
+    const uint8_t* end = in + length;
+    do {
+        if (end - bytes < 4) return truncatedData;
+        uint32_t magic = readLE32(bytes);
+        if ((magic & 0xFFFFFFF0) == 0x184D2A50) {
+            // Skippable frames hold metadata for other tools
+            if (end - bytes < 8) return truncatedData;
+            size_t size = readLE32(bytes + 4);
+            if (size > (size_t)(end - bytes) - 8) return truncatedData;
+            bytes += 8 + size;
+            continue;
+        }
+        if (magic != LZ4_MAGIC) return lz4NotFrame;
+
+        const uint8_t* descriptor = bytes + 4;
+        if (end - descriptor < 3) return truncatedData;
+        uint8_t flags = descriptor[0];
+        uint8_t blockFlags = descriptor[1];
+        if (flags >> 6 != 1 || (flags & 0x02) || (blockFlags & 0x8F) || blockFlags >> 4 < 4) {
+            return lz4BadHeader;
+        }
+        if (flags & 0x01) return "an LZ4 frame that needs a dictionary";
+        bool independent = flags & 0x20;
+        bool blockChecksums = flags & 0x10;
+        bool hasSize = flags & 0x08;
+        bool contentChecksum = flags & 0x04;
+        size_t blockMax = (size_t)1 << (2 * (blockFlags >> 4) + 8);
+        size_t headerLength = hasSize ? 10 : 2;
+        if ((size_t)(end - descriptor) < headerLength + 1) return truncatedData;
+        if (lz4HeaderChecksum(descriptor, headerLength) != descriptor[headerLength]) {
+            return lz4BadHeader;
+        }
+        uint64_t contentSize = hasSize ? readLE64(descriptor + 2) : 0;
+        bytes = descriptor + headerLength + 1;
+
+        size_t frameStart = sinkSize(out);
+        startSum(out, contentChecksum ? SUM_XXHASH32 : SUM_NONE);
+        for (;;) {
+            if (end - bytes < 4) return truncatedData;
+            uint32_t size = readLE32(bytes);
+            bytes += 4;
+            if (size == 0) break;
+            bool stored = size & 0x80000000;
+            size &= 0x7FFFFFFF;
+            size_t checksumLength = blockChecksums ? 4 : 0;
+            if (size > blockMax) return lz4Corrupt;
+            if ((size_t)(end - bytes) < size + checksumLength) return truncatedData;
+            if (blockChecksums) {
+                Xxhash32 xxhash;
+                startXxhash32(&xxhash, 0);
+                updateXxhash32(&xxhash, (const char*)bytes, size);
+                if (finishXxhash32(&xxhash) != readLE32(bytes + size)) {
+                    return "an LZ4 block checksum mismatch";
+                }
+            }
+            if (stored) {
+                if (!makeRoom(out, size)) return out->problem;
+                memcpy(out->next, bytes, size);
+                out->next += size;
+            } else {
+                const char* problem = lz4DecodeBlock(bytes, size, out, blockMax, independent);
+                if (problem != NULL) return problem;
+            }
+            bytes += size + checksumLength;
+        }
+        if (contentChecksum) {
+            if (end - bytes < 4) return truncatedData;
+            if (finishSum(out) != readLE32(bytes)) return "an LZ4 content checksum mismatch";
+            bytes += 4;
+        }
+        if (hasSize && sinkSize(out) - frameStart != contentSize) {
+            return "an LZ4 frame shorter or longer than its header says";
+        }
+    } while (bytes < end);
+    return NULL;
+}
+
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_END_OF_BLOCK 256
+
+static const uint16_t lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t distanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const uint8_t distanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+// The order code length code lengths are stored in, likeliest used first
+static const uint8_t codeLengthOrder[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+// Lookups from a match to its symbols, and the fixed Huffman code
+static uint8_t lengthSymbols[DEFLATE_MAX_MATCH + 1];
+static uint8_t nearDistanceSymbols[256];    // By distance - 1
+static uint8_t farDistanceSymbols[256];     // By (distance - 1) >> 7
+static uint8_t fixedLiteralLengths[288];
+static uint8_t fixedDistanceLengths[30];
+static uint16_t fixedLiteralCodes[288];
+static uint16_t fixedDistanceCodes[30];
+static bool deflateTablesReady = false;
+
+static uint16_t reverseBits(uint16_t code, int length) {
+    uint16_t reversed = 0;
+    for (int i = 0; i < length; i++) {
+        reversed = (uint16_t)(reversed << 1 | (code & 1));
+        code >>= 1;
+    }
+    return reversed;
+}
+
+// Assigns canonical codes for the lengths, bit reversed since DEFLATE packs
+// codes starting from their most significant bit into the low end of bytes.
+static void buildCodes(const uint8_t* lengths, int count, uint16_t* codes) {
+    int lengthCounts[16] = {0};
+    for (int i = 0; i < count; i++) lengthCounts[lengths[i]]++;
+    lengthCounts[0] = 0;
+    uint16_t nextCodes[16];
+    uint16_t code = 0;
+    for (int length = 1; length < 16; length++) {
+        code = (uint16_t)((code + lengthCounts[length - 1]) << 1);
+        nextCodes[length] = code;
+    }
+    for (int i = 0; i < count; i++) {
+        if (lengths[i] != 0) codes[i] = reverseBits(nextCodes[lengths[i]]++, lengths[i]);
+    }
+}
+
+static void fillDeflateTables() {
+    for (int symbol = 0; symbol < 29; symbol++) {
+        int last = symbol == 28 ? DEFLATE_MAX_MATCH : lengthBase[symbol + 1] - 1;
+        for (int length = lengthBase[symbol]; length <= last; length++) {
+            lengthSymbols[length] = (uint8_t)symbol;
+        }
+    }
+    for (int symbol = 0; symbol < 30; symbol++) {
+        int first = distanceBase[symbol] - 1;
+        for (int distance = first; distance < first + (1 << distanceExtra[symbol]); distance++) {
+            if (distance < 256) {
+                nearDistanceSymbols[distance] = (uint8_t)symbol;
+            } else {
+                farDistanceSymbols[distance >> 7] = (uint8_t)symbol;
+            }
+        }
+    }
+    for (int i = 0; i < 288; i++) {
+        fixedLiteralLengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    }
+    memset(fixedDistanceLengths, 5, sizeof(fixedDistanceLengths));
+    buildCodes(fixedLiteralLengths, 288, fixedLiteralCodes);
+    buildCodes(fixedDistanceLengths, 30, fixedDistanceCodes);
+    deflateTablesReady = true;
+}
+
+static int distanceSymbol(uint32_t distance) {
+    distance--;
+    return distance < 256 ? nearDistanceSymbols[distance] : farDistanceSymbols[distance >> 7];
+}
+
+// Lazy matching in the style of zlib's middle levels: after finding a match,
+// look one byte further for a longer one before committing to it.
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_MAX_CHAIN 32    // Earlier positions to try per match
+#define DEFLATE_GOOD_LENGTH 8   // Try a quarter as many after a match this long
+#define DEFLATE_LAZY_LENGTH 32  // Don't look for better after a match this long
+#define DEFLATE_NICE_LENGTH 128 // Stop searching at a match this long
+#define DEFLATE_TOO_FAR 4096    // Three bytes this far back cost more than literals
+#define DEFLATE_BLOCK_ITEMS 32768
+
+typedef struct {
+    uint64_t bits;
+    int count;
+    uint8_t* next;
+} BitWriter;
+
+typedef struct {
+    // Most recent position for each hash of 3 bytes, and the one before it
+    // with the same hash for each position in the window. Positions are
+    // stored modulo 2^32 and checked against the data before use, so stale
+    // entries only cost a comparison.
+    uint32_t* head;
+    uint32_t* chain;
+    int hashBits;
+    uint32_t chainMask;
+
+    // A block's worth of literals and matches, a match being its length << 16
+    // | its distance, and how often each symbol appears in them
+    uint32_t* items;
+    int itemCount;
+    uint32_t literalFreqs[286];
+    uint32_t distanceFreqs[30];
+
+    BitWriter writer;
+} Deflater;
+
+static void putBits(BitWriter* writer, uint32_t value, int count) {
+    writer->bits |= (uint64_t)value << writer->count;
+    writer->count += count;
+    if (writer->count >= 32) {
+        writeLE32(writer->next, (uint32_t)writer->bits);
+        writer->next += 4;
+        writer->bits >>= 32;
+        writer->count -= 32;
+    }
+}
+
+// Pads to a byte boundary and writes out every whole byte.
+static void alignBits(BitWriter* writer) {
+    writer->count = (writer->count + 7) & ~7;
+    for (; writer->count > 0; writer->count -= 8) {
+        *writer->next++ = (uint8_t)writer->bits;
+        writer->bits >>= 8;
+    }
+}
+
+static int compareFreqs(const void* a, const void* b) {
+    uint32_t left = *(const uint32_t*)a;
+    uint32_t right = *(const uint32_t*)b;
+    return left < right ? -1 : left > right;
+}
+
+// Turns frequencies sorted ascending into code lengths in place, with
+// Moffat and Katajainen's method for building a Huffman tree in an array.
+static void minimumRedundancy(int* a, int count) {
+    a[0] += a[1];
+    int root = 0;
+    int leaf = 2;
+    for (int next = 1; next < count - 1; next++) {
+        if (leaf >= count || a[root] < a[leaf]) {
+            a[next] = a[root];
+            a[root++] = next;
+        } else {
+            a[next] = a[leaf++];
+        }
+        if (leaf >= count || (root < next && a[root] < a[leaf])) {
+            a[next] += a[root];
+            a[root++] = next;
+        } else {
+            a[next] += a[leaf++];
+        }
+    }
+
+    a[count - 2] = 0;
+    for (int next = count - 3; next >= 0; next--) a[next] = a[a[next]] + 1;
+
+    int available = 1;
+    int used = 0;
+    int depth = 0;
+    root = count - 2;
+    int next = count - 1;
+    while (available > 0) {
+        while (root >= 0 && a[root] == depth) {
+            used++;
+            root--;
+        }
+        while (available > used) {
+            a[next--] = depth;
+            available--;
+        }
+        available = 2 * used;
+        depth++;
+        used = 0;
+    }
+}
+
+// Sets lengths to a Huffman code for freqs no longer than maxLength bits. At
+// least two symbols always get a code, since a lone one-bit code is a corner
+// some inflaters refuse.
+static void buildLengths(const uint32_t* freqs, int count, int maxLength, uint8_t* lengths) {
+    uint32_t sorted[288];
+    int used = 0;
+    for (int i = 0; i < count; i++) {
+        lengths[i] = 0;
+        if (freqs[i] != 0) sorted[used++] = freqs[i] << 16 | (uint32_t)i;
+    }
+    for (int i = 0; used < 2; i++) {
+        if (freqs[i] == 0) sorted[used++] = (uint32_t)i;
+    }
+    qsort(sorted, used, sizeof(uint32_t), compareFreqs);
+
+    int depths[288];
+    for (int i = 0; i < used; i++) depths[i] = (int)(sorted[i] >> 16);
+    minimumRedundancy(depths, used);
+
+    // Fold codes that came out too long back under the limit, then lengthen
+    // shorter ones until the code is complete again, as miniz does
+    int lengthCounts[33] = {0};
+    for (int i = 0; i < used; i++) lengthCounts[depths[i] < 32 ? depths[i] : 32]++;
+    for (int length = maxLength + 1; length <= 32; length++) {
+        lengthCounts[maxLength] += lengthCounts[length];
+    }
+    uint32_t total = 0;
+    for (int length = maxLength; length > 0; length--) {
+        total += (uint32_t)lengthCounts[length] << (maxLength - length);
+    }
+    for (; total != 1U << maxLength; total--) {
+        lengthCounts[maxLength]--;
+        for (int length = maxLength - 1; length > 0; length--) {
+            if (lengthCounts[length] != 0) {
+                lengthCounts[length]--;
+                lengthCounts[length + 1] += 2;
+                break;
+            }
+        }
+    }
+
+    // The rarest symbols get the longest codes
+    int next = 0;
+    for (int length = maxLength; length > 0; length--) {
+        for (int i = 0; i < lengthCounts[length]; i++) {
+            lengths[sorted[next++] & 0xFFFF] = (uint8_t)length;
+        }
+    }
+}
+
+// Run-length codes the lengths of a dynamic block's codes with symbols 16 to
+// 18, storing each as its symbol | its extra bits << 8.
+static int encodeLengths(const uint8_t* lengths, int count, uint16_t* runs, uint32_t* freqs) {
+    int runCount = 0;
+    for (int i = 0; i < count;) {
+        uint8_t length = lengths[i];
+        int run = 1;
+        while (i + run < count && lengths[i + run] == length) run++;
+        i += run;
+        if (length == 0) {
+            for (; run >= 11; ) {
+                int repeat = run < 138 ? run : 138;
+                runs[runCount++] = (uint16_t)(18 | (repeat - 11) << 8);
+                freqs[18]++;
+                run -= repeat;
+            }
+            if (run >= 3) {
+                runs[runCount++] = (uint16_t)(17 | (run - 3) << 8);
+                freqs[17]++;
+                run = 0;
+            }
+        } else {
+            runs[runCount++] = length;
+            freqs[length]++;
+            run--;
+            for (; run >= 3; ) {
+                int repeat = run < 6 ? run : 6;
+                runs[runCount++] = (uint16_t)(16 | (repeat - 3) << 8);
+                freqs[16]++;
+                run -= repeat;
+            }
+        }
+        for (; run > 0; run--) {
+            runs[runCount++] = length;
+            freqs[length]++;
+        }
+    }
+    return runCount;
+}
+
+static void writeItems(Deflater* deflater, const uint16_t* literalCodes,
+                       const uint8_t* literalLengths, const uint16_t* distanceCodes,
+                       const uint8_t* distanceLengths) {
+    BitWriter* writer = &deflater->writer;
+    for (int i = 0; i < deflater->itemCount; i++) {
+        uint32_t item = deflater->items[i];
+        if (item < 256) {
+            putBits(writer, literalCodes[item], literalLengths[item]);
+            continue;
+        }
+        uint32_t length = item >> 16;
+        uint32_t distance = item & 0xFFFF;
+        int symbol = lengthSymbols[length];
+        putBits(writer, literalCodes[257 + symbol], literalLengths[257 + symbol]);
+        putBits(writer, length - lengthBase[symbol], lengthExtra[symbol]);
+        symbol = distanceSymbol(distance);
+        putBits(writer, distanceCodes[symbol], distanceLengths[symbol]);
+        putBits(writer, distance - distanceBase[symbol], distanceExtra[symbol]);
+    }
+    putBits(writer, literalCodes[DEFLATE_END_OF_BLOCK], literalLengths[DEFLATE_END_OF_BLOCK]);
+}
+
+// Writes the pending items as a block, whichever of stored, fixed or dynamic
+// Huffman is smallest. raw is the input they cover, for a stored block.
+static bool writeBlock(Deflater* deflater, Sink* out, const uint8_t* raw, size_t rawLength,
+                       bool final) {
+    deflater->literalFreqs[DEFLATE_END_OF_BLOCK] = 1;
+    uint8_t literalLengths[286];
+    uint8_t distanceLengths[30];
+    buildLengths(deflater->literalFreqs, 286, 15, literalLengths);
+    buildLengths(deflater->distanceFreqs, 30, 15, distanceLengths);
+    int literalCount = 286;
+    while (literalLengths[literalCount - 1] == 0) literalCount--;
+    int distanceCount = 30;
+    while (distanceLengths[distanceCount - 1] == 0) distanceCount--;
+
+    uint8_t lengths[286 + 30];
+    memcpy(lengths, literalLengths, literalCount);
+    memcpy(lengths + literalCount, distanceLengths, distanceCount);
+    uint16_t runs[286 + 30];
+    uint32_t runFreqs[19] = {0};
+    int runCount = encodeLengths(lengths, literalCount + distanceCount, runs, runFreqs);
+    uint8_t runLengths[19];
+    buildLengths(runFreqs, 19, 7, runLengths);
+    int runLengthCount = 19;
+    while (runLengthCount > 4 && runLengths[codeLengthOrder[runLengthCount - 1]] == 0) {
+        runLengthCount--;
+    }
+
+    // Sizes in bits
+    uint64_t extraBits = 0;
+    for (int i = 0; i < 29; i++) {
+        extraBits += (uint64_t)deflater->literalFreqs[257 + i] * lengthExtra[i];
+    }
+    for (int i = 0; i < 30; i++) {
+        extraBits += (uint64_t)deflater->distanceFreqs[i] * distanceExtra[i];
+    }
+    uint64_t dynamicSize = 3 + 14 + 3 * runLengthCount + extraBits +
+                           2 * runFreqs[16] + 3 * runFreqs[17] + 7 * runFreqs[18];
+    for (int i = 0; i < 19; i++) dynamicSize += (uint64_t)runFreqs[i] * runLengths[i];
+    uint64_t fixedSize = 3 + extraBits;
+    for (int i = 0; i < 286; i++) {
+        dynamicSize += (uint64_t)deflater->literalFreqs[i] * literalLengths[i];
+        fixedSize += (uint64_t)deflater->literalFreqs[i] * fixedLiteralLengths[i];
+    }
+    for (int i = 0; i < 30; i++) {
+        dynamicSize += (uint64_t)deflater->distanceFreqs[i] * distanceLengths[i];
+        fixedSize += (uint64_t)deflater->distanceFreqs[i] * 5;
+    }
+    size_t storedCount = rawLength / 65535 + 1;
+    uint64_t storedSize = ((uint64_t)rawLength + 5 * storedCount) * 8;
+
+    uint64_t size = dynamicSize < fixedSize ? dynamicSize : fixedSize;
+    if (storedSize < size) size = storedSize;
+    if (!makeRoom(out, (size_t)(size / 8) + 16)) return false;
+    BitWriter* writer = &deflater->writer;
+    writer->next = out->next;
+
+    if (size == storedSize) {
+        for (size_t i = 0; i < storedCount; i++) {
+            size_t count = rawLength < 65535 ? rawLength : 65535;
+            putBits(writer, final && i == storedCount - 1, 1);
+            putBits(writer, 0, 2);
+            alignBits(writer);
+            writeLE16(writer->next, (uint16_t)count);
+            writeLE16(writer->next + 2, (uint16_t)~count);
+            memcpy(writer->next + 4, raw, count);
+            writer->next += 4 + count;
+            raw += count;
+            rawLength -= count;
+        }
+    } else if (size == fixedSize) {
+        putBits(writer, final, 1);
+        putBits(writer, 1, 2);
+        writeItems(deflater, fixedLiteralCodes, fixedLiteralLengths, fixedDistanceCodes,
+                   fixedDistanceLengths);
+    } else {
+        putBits(writer, final, 1);
+        putBits(writer, 2, 2);
+        putBits(writer, literalCount - 257, 5);
+        putBits(writer, distanceCount - 1, 5);
+        putBits(writer, runLengthCount - 4, 4);
+        for (int i = 0; i < runLengthCount; i++) putBits(writer, runLengths[codeLengthOrder[i]], 3);
+        uint16_t runCodes[19];
+        buildCodes(runLengths, 19, runCodes);
+        for (int i = 0; i < runCount; i++) {
+            int symbol = runs[i] & 0xFF;
+            putBits(writer, runCodes[symbol], runLengths[symbol]);
+            if (symbol >= 16) {
+                putBits(writer, runs[i] >> 8, symbol == 16 ? 2 : symbol == 17 ? 3 : 7);
+            }
+        }
+        uint16_t literalCodes[286];
+        uint16_t distanceCodes[30];
+        buildCodes(literalLengths, 286, literalCodes);
+        buildCodes(distanceLengths, 30, distanceCodes);
+        writeItems(deflater, literalCodes, literalLengths, distanceCodes, distanceLengths);
+    }
+
+    out->next = writer->next;
+    deflater->itemCount = 0;
+    memset(deflater->literalFreqs, 0, sizeof(deflater->literalFreqs));
+    memset(deflater->distanceFreqs, 0, sizeof(deflater->distanceFreqs));
+    return true;
+}
+
+static uint32_t deflateHash(const uint8_t* bytes, int hashBits) {
+    uint32_t sequence = (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16;
+    return (sequence * 2654435761U) >> (32 - hashBits);
+}
+
+static void insertPosition(Deflater* deflater, const uint8_t* in, size_t position) {
+    uint32_t hash = deflateHash(in + position, deflater->hashBits);
+    deflater->chain[position & deflater->chainMask] = deflater->head[hash];
+    deflater->head[hash] = (uint32_t)position;
+}
+
+// Follows the chain from candidate for a match longer than best and returns
+// its length, or 0 if there isn't one.
+static int longestMatch(Deflater* deflater, const uint8_t* in, size_t length, size_t position,
+                        uint32_t candidate, int best, uint32_t* distance) {
+    const uint8_t* bytes = in + position;
+    int limit = length - position < DEFLATE_MAX_MATCH ? (int)(length - position)
+                                                      : DEFLATE_MAX_MATCH;
+    if (best < DEFLATE_MIN_MATCH - 1) best = DEFLATE_MIN_MATCH - 1;
+    if (best >= limit) return 0;
+    int tries = best >= DEFLATE_GOOD_LENGTH ? DEFLATE_MAX_CHAIN / 4 : DEFLATE_MAX_CHAIN;
+    int found = 0;
+    uint32_t lastDistance = 0;
+    for (; tries > 0; tries--) {
+        uint32_t candidateDistance = (uint32_t)position - candidate;
+        // Distances only grow along a chain, so anything else is stale
+        if (candidateDistance <= lastDistance || candidateDistance > DEFLATE_WINDOW ||
+            candidateDistance > position) {
+            break;
+        }
+        const uint8_t* match = bytes - candidateDistance;
+        if (match[best] == bytes[best] && match[0] == bytes[0] && match[1] == bytes[1]) {
+            int matched = (int)countMatch(match, bytes, bytes + limit);
+            if (matched > best) {
+                best = found = matched;
+                *distance = candidateDistance;
+                if (matched >= DEFLATE_NICE_LENGTH || matched == limit) break;
+            }
+        }
+        lastDistance = candidateDistance;
+        candidate = deflater->chain[candidate & deflater->chainMask];
+    }
+    return found;
+}
+
+static void addLiteral(Deflater* deflater, uint8_t byte) {
+    deflater->items[deflater->itemCount++] = byte;
+    deflater->literalFreqs[byte]++;
+}
+
+static void addMatch(Deflater* deflater, int length, uint32_t distance) {
+    deflater->items[deflater->itemCount++] = (uint32_t)length << 16 | distance;
+    deflater->literalFreqs[257 + lengthSymbols[length]]++;
+    deflater->distanceFreqs[distanceSymbol(distance)]++;
+}
+
+static const char* deflateData(const uint8_t* in, size_t length, Sink* out) {
+    if (!deflateTablesReady) fillDeflateTables();
+
+    // Small inputs don't need the full tables
+    Deflater deflater;
+    deflater.hashBits = DEFLATE_HASH_BITS;
+    while (deflater.hashBits > 8 && ((size_t)1 << deflater.hashBits) > length * 2) {
+        deflater.hashBits--;
+    }
+    size_t chainSize = DEFLATE_WINDOW;
+    while (chainSize > 256 && chainSize / 2 >= length) chainSize /= 2;
+    deflater.chainMask = (uint32_t)chainSize - 1;
+    deflater.head = ALLOCATE(uint32_t, (size_t)1 << deflater.hashBits);
+    deflater.chain = ALLOCATE(uint32_t, chainSize);
+    deflater.items = ALLOCATE(uint32_t, DEFLATE_BLOCK_ITEMS);
+    memset(deflater.head, 0, sizeof(uint32_t) << deflater.hashBits);
+    memset(deflater.literalFreqs, 0, sizeof(deflater.literalFreqs));
+    memset(deflater.distanceFreqs, 0, sizeof(deflater.distanceFreqs));
+    deflater.itemCount = 0;
+    deflater.writer.bits = 0;
+    deflater.writer.count = 0;
+
+    const char* problem = NULL;
+    size_t blockStart = 0;
+    size_t position = 0;
+    // The match found at the position before this one, which is held back
+    // in case this one has a longer match
+    bool pending = false;
+    int pendingLength = 0;
+    uint32_t pendingDistance = 0;
+
+    while (position < length) {
+        int matchLength = 0;
+        uint32_t matchDistance = 0;
+        if (length - position >= DEFLATE_MIN_MATCH) {
+            uint32_t hash = deflateHash(in + position, deflater.hashBits);
+            uint32_t candidate = deflater.head[hash];
+            deflater.chain[position & deflater.chainMask] = candidate;
+            deflater.head[hash] = (uint32_t)position;
+            if (pendingLength < DEFLATE_LAZY_LENGTH) {
+                matchLength = longestMatch(&deflater, in, length, position, candidate,
+                                           pendingLength, &matchDistance);
+                if (matchLength == DEFLATE_MIN_MATCH && matchDistance > DEFLATE_TOO_FAR) {
+                    matchLength = 0;
+                }
+            }
+        }
+
+        if (pending && pendingLength >= DEFLATE_MIN_MATCH && matchLength <= pendingLength) {
+            addMatch(&deflater, pendingLength, pendingDistance);
+            size_t matchEnd = position - 1 + pendingLength;
+            size_t hashEnd = matchEnd < length - 2 ? matchEnd : length - 2;
+            for (size_t i = position + 1; i < hashEnd; i++) insertPosition(&deflater, in, i);
+            position = matchEnd;
+            pending = false;
+            pendingLength = 0;
+        } else {
+            if (pending) addLiteral(&deflater, in[position - 1]);
+            pending = true;
+            pendingLength = matchLength;
+            pendingDistance = matchDistance;
+            position++;
+        }
+
+        if (deflater.itemCount >= DEFLATE_BLOCK_ITEMS - 1) {
+            size_t blockEnd = position - pending;
+            if (!writeBlock(&deflater, out, in + blockStart, blockEnd - blockStart, false)) {
+                problem = out->problem;
+                break;
+            }
+            blockStart = blockEnd;
+        }
+    }
+
+    if (problem == NULL) {
+        if (pending) addLiteral(&deflater, in[length - 1]);
+        if (!writeBlock(&deflater, out, in + blockStart, length - blockStart, true) ||
+            !makeRoom(out, 8)) {
+            problem = out->problem;
+        } else {
+            deflater.writer.next = out->next;
+            alignBits(&deflater.writer);
+            out->next = deflater.writer.next;
+        }
+    }
+
+    FREE_ARRAY(uint32_t, deflater.head, (size_t)1 << deflater.hashBits);
+    FREE_ARRAY(uint32_t, deflater.chain, chainSize);
+    FREE_ARRAY(uint32_t, deflater.items, DEFLATE_BLOCK_ITEMS);
+    return problem;
+}
+
+static const char* gzipData(const uint8_t* in, size_t length, Sink* out) {
+    static const uint8_t header[10] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+    if (!makeRoom(out, sizeof(header))) return out->problem;
+    memcpy(out->next, header, sizeof(header));
+    out->next += sizeof(header);
+
+    const char* problem = deflateData(in, length, out);
+    if (problem != NULL) return problem;
+
+    if (!makeRoom(out, 8)) return out->problem;
+    writeLE32(out->next, computeCrc32((const char*)in, length));
+    writeLE32(out->next + 4, (uint32_t)length);
+    out->next += 8;
+    return NULL;
+}
+
+// Codes are decoded with a table indexed by the next few bits of input.
+// Codes longer than that point to a subtable for their remaining bits. An
+// entry holds its symbol, or subtable offset, above the number of bits it
+// takes, or of bits indexing its subtable. Zero marks a code that doesn't
+// exist.
+#define ENTRY_SUBTABLE 0x100
+#define LITERAL_TABLE_BITS 10
+#define DISTANCE_TABLE_BITS 8
+#define RUN_TABLE_BITS 7
+#define LITERAL_TABLE_SIZE ((1 << LITERAL_TABLE_BITS) + 288 * (1 << (15 - LITERAL_TABLE_BITS)))
+#define DISTANCE_TABLE_SIZE ((1 << DISTANCE_TABLE_BITS) + 32 * (1 << (15 - DISTANCE_TABLE_BITS)))
+
+static const char badCode[] = "an invalid DEFLATE code";
+static const char badTable[] = "a corrupt DEFLATE code table";
+
+typedef struct {
+    uint32_t literals[LITERAL_TABLE_SIZE];
+    uint32_t distances[DISTANCE_TABLE_SIZE];
+    uint32_t runs[1 << RUN_TABLE_BITS];
+} HuffmanTables;
+
+// Bits are taken from the bottom of a 64 bit buffer. Refilling past the end
+// of the input shifts in zero bytes and counts them, so reading too far is
+// caught once one of them is consumed.
+typedef struct {
+    const uint8_t* next;
+    const uint8_t* end;
+    uint64_t bits;
+    int count;
+    size_t overrun;
+} BitReader;
+
+static inline void refillBits(BitReader* reader) {
+    if (reader->end - reader->next >= 8) {
+        // Load a whole word and keep however many bytes fit. The bits above
+        // count are the right ones, so loading them again changes nothing.
+        reader->bits |= readLE64(reader->next) << reader->count;
+        reader->next += (63 - reader->count) >> 3;
+        reader->count |= 56;
+    } else {
+        for (; reader->count <= 56; reader->count += 8) {
+            if (reader->next < reader->end) {
+                reader->bits |= (uint64_t)*reader->next++ << reader->count;
+            } else {
+                reader->overrun++;
+            }
+        }
+    }
+}
+
+static inline uint32_t getBits(BitReader* reader, int count) {
+    uint32_t value = (uint32_t)(reader->bits & ((1ULL << count) - 1));
+    reader->bits >>= count;
+    reader->count -= count;
+    return value;
+}
+
+static bool overran(BitReader* reader) {
+    return reader->overrun * 8 > (size_t)reader->count;
+}
+
+static inline int decodeSymbol(BitReader* reader, const uint32_t* table, int tableBits) {
+    uint32_t entry = table[reader->bits & ((1U << tableBits) - 1)];
+    if (entry & ENTRY_SUBTABLE) {
+        getBits(reader, tableBits);
+        entry = table[(entry >> 16) + (reader->bits & ((1U << (entry & 0xFF)) - 1))];
+    }
+    int count = entry & 0xFF;
+    if (count == 0) return -1;
+    getBits(reader, count);
+    return (int)(entry >> 16);
+}
+
+// Fills in the table for the canonical code with these lengths. Returns false
+// if the lengths ask for more codes than there are. Too few is allowed and
+// leaves gaps, which only matter if the data tries to use one.
+static bool buildTable(uint32_t* table, const uint8_t* lengths, int count, int tableBits) {
+    int lengthCounts[16] = {0};
+    for (int i = 0; i < count; i++) lengthCounts[lengths[i]]++;
+    lengthCounts[0] = 0;
+    int left = 1;
+    int maxLength = 0;
+    for (int length = 1; length < 16; length++) {
+        left = (left << 1) - lengthCounts[length];
+        if (left < 0) return false;
+        if (lengthCounts[length] != 0) maxLength = length;
+    }
+
+    // Symbols in code order: by length, then by symbol
+    int offsets[16];
+    offsets[1] = 0;
+    for (int length = 1; length < 15; length++) {
+        offsets[length + 1] = offsets[length] + lengthCounts[length];
+    }
+    uint16_t sorted[288];
+    for (int i = 0; i < count; i++) {
+        if (lengths[i] != 0) sorted[offsets[lengths[i]]++] = (uint16_t)i;
+    }
+    int codeCount = maxLength == 0 ? 0 : offsets[maxLength];
+
+    int tableSize = 1 << tableBits;
+    memset(table, 0, sizeof(uint32_t) * tableSize);
+    int subtableBits = maxLength - tableBits;
+    int nextSubtable = tableSize;
+    int prefix = -1;
+    int subtable = 0;
+    uint16_t code = 0;
+    int codeLength = 0;
+    for (int i = 0; i < codeCount; i++) {
+        int symbol = sorted[i];
+        int length = lengths[symbol];
+        code = (uint16_t)(code << (length - codeLength));
+        codeLength = length;
+        uint32_t reversed = reverseBits(code++, length);
+        if (length <= tableBits) {
+            for (uint32_t index = reversed; index < (uint32_t)tableSize; index += 1U << length) {
+                table[index] = (uint32_t)symbol << 16 | (uint32_t)length;
+            }
+            continue;
+        }
+        // Codes sharing their first tableBits bits are adjacent in code order
+        if ((int)(reversed & (tableSize - 1)) != prefix) {
+            prefix = (int)(reversed & (tableSize - 1));
+            subtable = nextSubtable;
+            nextSubtable += 1 << subtableBits;
+            memset(table + subtable, 0, sizeof(uint32_t) << subtableBits);
+            table[prefix] = (uint32_t)subtable << 16 | ENTRY_SUBTABLE | (uint32_t)subtableBits;
+        }
+        int rest = length - tableBits;
+        for (uint32_t index = reversed >> tableBits; index < 1U << subtableBits;
+             index += 1U << rest) {
+            table[subtable + index] = (uint32_t)symbol << 16 | (uint32_t)rest;
+        }
+    }
+    return true;
+}
+
+static void buildFixedTables(HuffmanTables* tables) {
+    if (!deflateTablesReady) fillDeflateTables();
+    buildTable(tables->literals, fixedLiteralLengths, 288, LITERAL_TABLE_BITS);
+    buildTable(tables->distances, fixedDistanceLengths, 30, DISTANCE_TABLE_BITS);
+}
+
+static const char* readDynamicTables(BitReader* reader, HuffmanTables* tables) {
+    refillBits(reader);
+    int literalCount = (int)getBits(reader, 5) + 257;
+    int distanceCount = (int)getBits(reader, 5) + 1;
+    int runLengthCount = (int)getBits(reader, 4) + 4;
+    if (literalCount > 286 || distanceCount > 30) return badTable;
+
+    uint8_t runLengths[19] = {0};
+    for (int i = 0; i < runLengthCount; i++) {
+        refillBits(reader);
+        runLengths[codeLengthOrder[i]] = (uint8_t)getBits(reader, 3);
+    }
+    if (!buildTable(tables->runs, runLengths, 19, RUN_TABLE_BITS)) return badTable;
+
+    uint8_t lengths[286 + 30];
+    int total = literalCount + distanceCount;
+    for (int i = 0; i < total;) {
+        if (overran(reader)) return truncatedData;
+        refillBits(reader);
+        int symbol = decodeSymbol(reader, tables->runs, RUN_TABLE_BITS);
+        if (symbol < 0) return badTable;
+        if (symbol < 16) {
+            lengths[i++] = (uint8_t)symbol;
+            continue;
+        }
+        uint8_t length = 0;
+        int repeat;
+        if (symbol == 16) {
+            if (i == 0) return badTable;
+            length = lengths[i - 1];
+            repeat = 3 + (int)getBits(reader, 2);
+        } else if (symbol == 17) {
+            repeat = 3 + (int)getBits(reader, 3);
+        } else {
+            repeat = 11 + (int)getBits(reader, 7);
+        }
+        if (repeat > total - i) return badTable;
+        memset(lengths + i, length, repeat);
+        i += repeat;
+    }
+    if (lengths[DEFLATE_END_OF_BLOCK] == 0 ||
+        !buildTable(tables->literals, lengths, literalCount, LITERAL_TABLE_BITS) ||
+        !buildTable(tables->distances, lengths + literalCount, distanceCount,
+                    DISTANCE_TABLE_BITS)) {
+        return badTable;
+    }
+    return NULL;
+}
+
+static const char* inflateStored(BitReader* reader, Sink* out) {
+    // Drop to a byte boundary and hand back the bytes still buffered
+    getBits(reader, reader->count & 7);
+    if (overran(reader)) return truncatedData;
+    reader->next -= (size_t)(reader->count >> 3) - reader->overrun;
+    reader->bits = 0;
+    reader->count = 0;
+    reader->overrun = 0;
+
+    if (reader->end - reader->next < 4) return truncatedData;
+    uint16_t length = readLE16(reader->next);
+    if ((length ^ readLE16(reader->next + 2)) != 0xFFFF) return "a corrupt stored DEFLATE block";
+    reader->next += 4;
+    if (reader->end - reader->next < length) return truncatedData;
+    if (!makeRoom(out, length)) return out->problem;
+    memcpy(out->next, reader->next, length);
+    out->next += length;
+    reader->next += length;
+    return NULL;
+}
+
+// Decodes a Huffman block. Matches may reach back as far as the stream's
+// start at streamStart.
+static const char* inflateHuffman(BitReader* reader, Sink* out, HuffmanTables* tables,
+                                  size_t streamStart) {
+    // Work on copies so stores through next can't force them back to memory
+    BitReader bits = *reader;
+    uint8_t* next = out->next;
+    uint8_t* end = out->end;
+    const char* problem = NULL;
+    for (;;) {
+        if (bits.overrun > 0 && overran(&bits)) {
+            problem = truncatedData;
+            break;
+        }
+        refillBits(&bits);
+        int symbol = decodeSymbol(&bits, tables->literals, LITERAL_TABLE_BITS);
+        if (symbol < 256) {
+            if (symbol < 0) {
+                problem = badCode;
+                break;
+            }
+            if (next == end) {
+                out->next = next;
+                if (!makeRoom(out, 1)) {
+                    problem = out->problem;
+                    break;
+                }
+                next = out->next;
+                end = out->end;
+            }
+            *next++ = (uint8_t)symbol;
+            continue;
+        }
+        if (symbol == DEFLATE_END_OF_BLOCK) break;
+
+        symbol -= 257;
+        if (symbol >= 29) {
+            problem = badCode;
+            break;
+        }
+        size_t length = lengthBase[symbol] + getBits(&bits, lengthExtra[symbol]);
+        symbol = decodeSymbol(&bits, tables->distances, DISTANCE_TABLE_BITS);
+        if (symbol < 0 || symbol >= 30) {
+            problem = badCode;
+            break;
+        }
+        size_t distance = distanceBase[symbol] + getBits(&bits, distanceExtra[symbol]);
+
+        if ((size_t)(end - next) < length) {
+            out->next = next;
+            if (!makeRoom(out, length)) {
+                problem = out->problem;
+                break;
+            }
+            next = out->next;
+            end = out->end;
+        }
+        if (distance > (size_t)(next - out->start) ||
+            distance > out->drained + (size_t)(next - out->flushed) - streamStart) {
+            problem = "a DEFLATE match reaching back before the start";
+            break;
+        }
+        copyMatch(next, distance, length, (size_t)(end - next));
+        next += length;
+    }
+    out->next = next;
+    *reader = bits;
+    return problem;
+}
+
+// Inflates one DEFLATE stream and sets used to how many bytes it took up.
+static const char* inflateData(const uint8_t* in, size_t length, Sink* out, size_t* used) {
+    if (!deflateTablesReady) fillDeflateTables();
+    HuffmanTables* tables = ALLOCATE(HuffmanTables, 1);
+    BitReader reader = {in, in + length, 0, 0, 0};
+    size_t streamStart = sinkSize(out);
+    const char* problem = NULL;
+    bool final = false;
+    while (!final && problem == NULL) {
+        refillBits(&reader);
+        final = getBits(&reader, 1);
+        switch (getBits(&reader, 2)) {
+            case 0:
+                problem = inflateStored(&reader, out);
+                break;
+            case 1:
+                buildFixedTables(tables);
+                problem = inflateHuffman(&reader, out, tables, streamStart);
+                break;
+            case 2:
+                problem = readDynamicTables(&reader, tables);
+                if (problem == NULL) problem = inflateHuffman(&reader, out, tables, streamStart);
+                break;
+            default:
+                problem = "a DEFLATE block of unknown type";
+                break;
+        }
+        if (problem == NULL && overran(&reader)) problem = truncatedData;
+    }
+    FREE(HuffmanTables, tables);
+    *used = (size_t)(reader.next - in) - ((size_t)(reader.count >> 3) - reader.overrun);
+    return problem;
+}
+
+static const char* inflateRaw(const uint8_t* in, size_t length, Sink* out) {
+    size_t used;
+    const char* problem = inflateData(in, length, out, &used);
+    if (problem == NULL && used != length) problem = trailingData;
+    return problem;
+}
+
+// Reads one or more gzip members, each a header, a DEFLATE stream and the
+// CRC-32 and length of what it holds.
+static const char* gunzipData(const uint8_t* in, size_t length, Sink* out) {
+    static const char notGzip[] = "data that isn't gzip";
+    const uint8_t* bytes = in;
+    const uint8_t* end = in + length;
+    do {
+        size_t available = (size_t)(end - bytes);
+        if ((available > 0 && bytes[0] != 0x1F) || (available > 1 && bytes[1] != 0x8B) ||
+            (available > 2 && bytes[2] != 8)) {
+            return notGzip;
+        }
+        if (available < 10) return truncatedData;
+        uint8_t flags = bytes[3];
+        if (flags & 0xE0) return "a gzip header with unknown flags";
+        bytes += 10;
+        if (flags & 0x04) {
+            // Extra fields
+            if (end - bytes < 2) return truncatedData;
+            size_t extraLength = readLE16(bytes);
+            bytes += 2;
+            if ((size_t)(end - bytes) < extraLength) return truncatedData;
+            bytes += extraLength;
+        }
+        // The original name and a comment, both ending in a zero byte
+        for (int field = 0x08; field <= 0x10; field <<= 1) {
+            if (!(flags & field)) continue;
+            const uint8_t* zero = memchr(bytes, 0, (size_t)(end - bytes));
+            if (zero == NULL) return truncatedData;
+            bytes = zero + 1;
+        }
+        if (flags & 0x02) {
+            // The header's own CRC
+            if (end - bytes < 2) return truncatedData;
+            bytes += 2;
+        }
+
+        size_t memberStart = sinkSize(out);
+        startSum(out, SUM_CRC32);
+        size_t used;
+        const char* problem = inflateData(bytes, (size_t)(end - bytes), out, &used);
+        if (problem != NULL) return problem;
+        bytes += used;
+        if (end - bytes < 8) return truncatedData;
+        if (finishSum(out) != readLE32(bytes)) return "a gzip checksum mismatch";
+        if ((uint32_t)(sinkSize(out) - memberStart) != readLE32(bytes + 4)) {
+            return "a gzip length mismatch";
+        }
+        bytes += 8;
+    } while (bytes < end);
+    return NULL;
+}
+
+static const char* encode(CompressFormat format, const uint8_t* in, size_t length,
+                          Sink* out) {
+    switch (format) {
+        case COMPRESS_LZ4: return lz4Compress(in, length, out);
+        case COMPRESS_DEFLATE: return deflateData(in, length, out);
+        case COMPRESS_GZIP: return gzipData(in, length, out);
+    }
+    return NULL;
+}
+
+static const char* decode(CompressFormat format, const uint8_t* in, size_t length,
+                          Sink* out) {
+    switch (format) {
+        case COMPRESS_LZ4: return lz4Decompress(in, length, out);
+        case COMPRESS_DEFLATE: return inflateRaw(in, length, out);
+        case COMPRESS_GZIP: return gunzipData(in, length, out);
+    }
+    return NULL;
+}
+
+// The most encoding can take, with the stored fallbacks for incompressible
+// data: 4 bytes per LZ4 block plus the slack its block encoder needs, or 5
+// bytes per stored DEFLATE block of at least 32K.
+static size_t compressBound(CompressFormat format, size_t length) {
+    switch (format) {
+        case COMPRESS_LZ4:
+            return LZ4_HEADER_SIZE + 8 + length + length / 255 + 4 * (length / LZ4_BLOCK_SIZE) + 20;
+        case COMPRESS_DEFLATE: return length + length / 4096 + 64;
+        case COMPRESS_GZIP: return length + length / 4096 + 64 + 18;
+    }
+    return length;
+}
+
+// The size the data says it decompresses to, if it says. Neither format can
+// expand by more than about 1000 times, so a claim of more is ignored.
+static bool declaredSize(CompressFormat format, const uint8_t* in, size_t length, size_t* size) {
+    uint64_t declared;
+    if (format == COMPRESS_LZ4 && length >= LZ4_HEADER_SIZE && readLE32(in) == LZ4_MAGIC &&
+        (in[4] & 0x08)) {
+        declared = readLE64(in + 6);
+    } else if (format == COMPRESS_GZIP && length >= 18) {
+        declared = readLE32(in + length - 4);
+    } else {
+        return false;
+    }
+    if (declared > (uint64_t)length * 1032 + 64 || declared > INT32_MAX) return false;
+    *size = (size_t)declared;
+    return true;
+}
+
+// Hands a memory sink's buffer over to new bytes, trimmed to what was written
+static Value sinkBytes(Sink* out) {
+    int length = (int)(out->next - out->start);
+    uint8_t* data = GROW_ARRAY(out->start, uint8_t, out->capacity, length);
+    out->start = NULL;
+    out->capacity = 0;
+    return OBJ_VAL(takeBytes(data, length, length));
+}
+
+bool compressBytes(CompressFormat format, const char* chars, size_t length, bool toBytes,
+                   Value* result, char* errMsg) {
+    size_t bound = compressBound(format, length);
+    if (bound > INT32_MAX) bound = INT32_MAX;
+    Sink out;
+    initSink(&out, ALLOCATE(uint8_t, bound), bound, -1, 0);
+    const char* problem = encode(format, (const uint8_t*)chars, length, &out);
+    if (problem != NULL) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "compress found %s.", problem);
+    } else if (toBytes) {
+        *result = sinkBytes(&out);
+    } else {
+        *result = OBJ_VAL(makeString((const char*)out.start, (int)(out.next - out.start)));
+    }
+    freeSink(&out);
+    return problem == NULL;
+}
+
+bool decompressBytes(CompressFormat format, const char* chars, size_t length, bool toBytes,
+                     Value* result, char* errMsg) {
+    const uint8_t* in = (const uint8_t*)chars;
+    Sink out;
+    size_t size;
+    bool declared = declaredSize(format, in, length, &size);
+    if (!declared) size = (uint64_t)length * 3 + 64 < INT32_MAX ? length * 3 + 64 : INT32_MAX;
+    // Bytes take over the buffer whatever its size, so only strings need this
+    bool inString = declared && !toBytes;
+    if (inString) {
+        ObjString* string = newString((int)size);
+        push(OBJ_VAL(string));
+        initSink(&out, (uint8_t*)string->chars, size, -1, 0);
+        out.string = string;
+    } else {
+        initSink(&out, ALLOCATE(uint8_t, size), size, -1, 0);
+    }
+
+    const char* problem = decode(format, in, length, &out);
+    if (problem != NULL) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "decompress found %s.", problem);
+    } else if (toBytes) {
+        *result = sinkBytes(&out);
+    } else if (out.string != NULL && out.next == out.end) {
+        *result = OBJ_VAL(out.string);
+    } else {
+        *result = OBJ_VAL(makeString((const char*)out.start, (int)(out.next - out.start)));
+    }
+    freeSink(&out);
+    if (inString) pop();
+    return problem == NULL;
+}
+
+static bool codeFile(const char* name, bool decoding, CompressFormat format,
+                     const char* inPath, const char* outPath, char* errMsg) {
+    if (isSameFile(inPath, outPath)) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "%s can't write over its input '%s'.", name, inPath);
+        return false;
+    }
+    char* chars;
+    size_t length;
+    if (!mapFile(inPath, &chars, &length)) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "%s could not read '%s'.", name, inPath);
+        return false;
+    }
+    int fd = createDescriptor(outPath);
+    if (fd < 0) {
+        unmapFile(chars, length);
+        snprintf(errMsg, NATIVE_ERROR_MAX, "%s could not write '%s'.", name, outPath);
+        return false;
+    }
+
+    Sink out;
+    initSink(&out, ALLOCATE(uint8_t, FILE_WINDOW), FILE_WINDOW, fd, decoding ? HISTORY_SIZE : 0);
+    const uint8_t* in = (const uint8_t*)chars;
+    const char* problem = decoding ? decode(format, in, length, &out)
+                                   : encode(format, in, length, &out);
+    if (problem == NULL && !drainSink(&out)) problem = out.problem;
+    freeSink(&out);
+    if (!closeDescriptor(fd) && problem == NULL) problem = writeFailure;
+    unmapFile(chars, length);
+
+    if (problem == writeFailure) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "%s could not write '%s'.", name, outPath);
+    } else if (problem != NULL) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "%s found %s.", name, problem);
+    }
+    return problem == NULL;
+}
+
+bool compressFile(CompressFormat format, const char* inPath, const char* outPath, char* errMsg) {
+    return codeFile("compressFile", false, format, inPath, outPath, errMsg);
+}
+
+bool decompressFile(CompressFormat format, const char* inPath, const char* outPath,
+                    char* errMsg) {
+    return codeFile("decompressFile", true, format, inPath, outPath, errMsg);
+}
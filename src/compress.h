@@ -0,0 +1,33 @@
+#ifndef nqq_compress_h
+#define nqq_compress_h
+
+#include "common.h"
+#include "value.h"
+
+// Self-contained codecs for the LZ4 frame format, raw DEFLATE and gzip, so
+// the output can be read by the lz4, zlib and gzip tools and theirs by us.
+// LZ4 trades ratio for speed with a single hash probe per position; DEFLATE
+// follows chains of earlier positions and picks the cheapest of stored,
+// fixed and dynamic Huffman blocks.
+typedef enum {
+    COMPRESS_LZ4,
+    COMPRESS_DEFLATE,
+    COMPRESS_GZIP,
+} CompressFormat;
+
+// The one-shot forms write into a single buffer allocated up front, sized for
+// the worst case when compressing and from the size the data declares when
+// decompressing, and return a string, or bytes that take over the buffer if
+// toBytes is set. The file forms map the input and write
+// the output a window at a time, so memory stays bounded whatever the size.
+// All return false and describe the problem in errMsg, which needs
+// NATIVE_ERROR_MAX bytes.
+bool compressBytes(CompressFormat format, const char* chars, size_t length, bool toBytes,
+                   Value* result, char* errMsg);
+bool decompressBytes(CompressFormat format, const char* chars, size_t length, bool toBytes,
+                     Value* result, char* errMsg);
+bool compressFile(CompressFormat format, const char* inPath, const char* outPath, char* errMsg);
+bool decompressFile(CompressFormat format, const char* inPath, const char* outPath,
+                    char* errMsg);
+
+#endif
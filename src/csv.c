@@ -0,0 +1,376 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "csv.h"
+#include "file.h"
+#include "memory.h"
+#include "number.h"
+#include "object.h"
+#include "reader.h"
+#include "search.h"
+#include "vm.h"
+
+// Where a field lies in the reader's buffer
+typedef struct {
+    int start;
+    int length;
+    bool quoted;
+    bool escaped;       // Still holds doubled quotes
+} CsvField;
+
+typedef struct {
+    Reader reader;
+    int fd;
+    CsvField* fields;   // Fields of the current record
+    int fieldCount;
+    int fieldCapacity;
+    char* scratch;      // Holds a field while its doubled quotes are collapsed
+    int scratchCapacity;
+    int record;         // Records read so far, including blank lines
+} CsvParser;
+
+typedef enum {
+    RECORD_READ,
+    RECORD_INCOMPLETE,  // Ran into the end of the buffer
+    RECORD_NONE,        // No input left
+    RECORD_MALFORMED,
+} RecordResult;
+
+static bool openCsv(CsvParser* parser, const char* path) {
+    parser->fd = openDescriptor(path);
+    if (parser->fd < 0) return false;
+    initReader(&parser->reader, parser->fd);
+    parser->fields = NULL;
+    parser->fieldCount = 0;
+    parser->fieldCapacity = 0;
+    parser->scratch = NULL;
+    parser->scratchCapacity = 0;
+    parser->record = 0;
+    return true;
+}
+
+static void closeCsv(CsvParser* parser) {
+    freeReader(&parser->reader);
+    FREE_ARRAY(CsvField, parser->fields, parser->fieldCapacity);
+    FREE_ARRAY(char, parser->scratch, parser->scratchCapacity);
+    closeDescriptor(parser->fd);
+}
+
+static void addField(CsvParser* parser, CsvField field) {
+    if (parser->fieldCapacity < parser->fieldCount + 1) {
+        int oldCapacity = parser->fieldCapacity;
+        parser->fieldCapacity = GROW_CAPACITY(oldCapacity);
+        parser->fields = GROW_ARRAY(parser->fields, CsvField, oldCapacity, parser->fieldCapacity);
+    }
+    parser->fields[parser->fieldCount++] = field;
+}
+
+// Splits the record at the front of the buffer into fields. Until the input
+// is exhausted a record that reaches the end of the buffer is incomplete, as
+// more input could still extend its last field. Unquoted fields are found with
+// the vectorized byte search: first the end of the line, then each comma.
+static RecordResult scanRecord(CsvParser* parser) {
+    Reader* reader = &parser->reader;
+    const char* chars = reader->buffer;
+    int end = reader->end;
+    bool atEnd = reader->eof;
+    int i = reader->start;
+    if (i == end) return atEnd ? RECORD_NONE : RECORD_INCOMPLETE;
+
+    parser->fieldCount = 0;
+    int lineEnd = -1;
+    for (;;) {
+        CsvField field = {i, 0, false, false};
+        if (i < end && chars[i] == '"') {
+            int quote = i + 1;
+            for (;;) {
+                quote = findByte(chars, end, quote, '"');
+                if (quote < 0) return atEnd ? RECORD_MALFORMED : RECORD_INCOMPLETE;
+                // Can't tell yet whether the quote is doubled
+                if (quote + 1 == end && !atEnd) return RECORD_INCOMPLETE;
+                if (quote + 1 < end && chars[quote + 1] == '"') {
+                    field.escaped = true;
+                    quote += 2;
+                    continue;
+                }
+                break;
+            }
+            field.start = i + 1;
+            field.length = quote - field.start;
+            field.quoted = true;
+            i = quote + 1;
+            if (i < end && chars[i] == '\r') i++;
+            lineEnd = -1;
+        } else {
+            if (lineEnd < i) {
+                lineEnd = findByte(chars, end, i, '\n');
+                if (lineEnd < 0) {
+                    if (!atEnd) return RECORD_INCOMPLETE;
+                    lineEnd = end;
+                }
+            }
+            int comma = findByte(chars, lineEnd, i, ',');
+            int fieldEnd = comma >= 0 ? comma : lineEnd;
+            field.length = fieldEnd - i;
+            if (fieldEnd == lineEnd && field.length > 0 && chars[fieldEnd - 1] == '\r') {
+                field.length--;
+            }
+            i = fieldEnd;
+        }
+        addField(parser, field);
+
+        if (i >= end) {
+            if (!atEnd) return RECORD_INCOMPLETE;
+            break;
+        }
+        if (chars[i] == '\n') {
+            i++;
+            break;
+        }
+        if (chars[i] != ',') return RECORD_MALFORMED;
+        i++;
+    }
+
+    // The fields stay valid until the buffer is next filled
+    reader->start = i;
+    parser->record++;
+    return RECORD_READ;
+}
+
+static RecordResult nextRecord(CsvParser* parser) {
+    for (;;) {
+        RecordResult result = scanRecord(parser);
+        if (result != RECORD_INCOMPLETE) return result;
+        // Slides the record to the front and reads more after it
+        fillReader(&parser->reader);
+    }
+}
+
+static bool isBlankRecord(CsvParser* parser) {
+    return parser->fieldCount == 1 && !parser->fields[0].quoted &&
+           parser->fields[0].length == 0;
+}
+
+// Returns the field's characters with doubled quotes collapsed and updates
+// its length to match. Only call once per field.
+static const char* fieldChars(CsvParser* parser, CsvField* field) {
+    const char* chars = parser->reader.buffer + field->start;
+    if (!field->escaped) return chars;
+
+    if (parser->scratchCapacity < field->length) {
+        int oldCapacity = parser->scratchCapacity;
+        parser->scratchCapacity = field->length;
+        parser->scratch = GROW_ARRAY(parser->scratch, char, oldCapacity, parser->scratchCapacity);
+    }
+    int length = 0;
+    for (int i = 0; i < field->length; i++) {
+        parser->scratch[length++] = chars[i];
+        if (chars[i] == '"') i++;
+    }
+    field->length = length;
+    return parser->scratch;
+}
+
+bool readCsvRows(const char* path, Value* result, char* errMsg) {
+    CsvParser parser;
+    if (!openCsv(&parser, path)) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "readCsv could not open '%s'.", path);
+        return false;
+    }
+
+    ObjList* rows = newList();
+    push(OBJ_VAL(rows));
+    RecordResult status;
+    while ((status = nextRecord(&parser)) == RECORD_READ) {
+        if (isBlankRecord(&parser)) continue;
+        ObjList* row = newList();
+        push(OBJ_VAL(row));
+        // With room reserved appending doesn't allocate, so the new strings
+        // can't be collected before they're in the row
+        reserveList(row, parser.fieldCount);
+        for (int i = 0; i < parser.fieldCount; i++) {
+            CsvField* field = &parser.fields[i];
+            const char* chars = fieldChars(&parser, field);
+            appendToList(row, OBJ_VAL(makeString(chars, field->length)));
+        }
+        appendToList(rows, OBJ_VAL(row));
+        pop();
+    }
+    closeCsv(&parser);
+
+    if (status == RECORD_MALFORMED) {
+        pop();
+        snprintf(errMsg, NATIVE_ERROR_MAX, "readCsv found a malformed quoted field in record %d.",
+                 parser.record + 1);
+        return false;
+    }
+    *result = pop();
+    return true;
+}
+
+// The cells of a numeric column whose text the file didn't write the way
+// formatNumber would, such as 007 or 1.50, kept until the column is known to
+// stay numeric so demoting it gives them back as written
+typedef struct {
+    char* chars;
+    size_t length;
+    size_t capacity;
+    int* cells;         // Index of each kept cell in the column
+    size_t* ends;       // End of each kept cell's text in chars
+    int count;
+    int cellCapacity;
+} CellTexts;
+
+// The text demoting gives a cell if none was kept for it
+static int cellText(double number, char* buffer) {
+    return isnan(number) ? 0 : formatNumber(number, buffer);
+}
+
+static void addCellText(CellTexts* texts, int cell, const char* chars, int length) {
+    if (texts->capacity < texts->length + length) {
+        size_t oldCapacity = texts->capacity;
+        size_t capacity = oldCapacity;
+        while (capacity < texts->length + length) capacity = GROW_CAPACITY(capacity);
+        texts->chars = GROW_ARRAY(texts->chars, char, oldCapacity, capacity);
+        texts->capacity = capacity;
+    }
+    if (texts->cellCapacity < texts->count + 1) {
+        int oldCapacity = texts->cellCapacity;
+        texts->cellCapacity = GROW_CAPACITY(oldCapacity);
+        texts->cells = GROW_ARRAY(texts->cells, int, oldCapacity, texts->cellCapacity);
+        texts->ends = GROW_ARRAY(texts->ends, size_t, oldCapacity, texts->cellCapacity);
+    }
+    memcpy(texts->chars + texts->length, chars, length);
+    texts->length += length;
+    texts->cells[texts->count] = cell;
+    texts->ends[texts->count++] = texts->length;
+}
+
+static void freeCellTexts(CellTexts* texts) {
+    FREE_ARRAY(char, texts->chars, texts->capacity);
+    FREE_ARRAY(int, texts->cells, texts->cellCapacity);
+    FREE_ARRAY(size_t, texts->ends, texts->cellCapacity);
+    *texts = (CellTexts){NULL, 0, 0, NULL, NULL, 0, 0};
+}
+
+// Replaces a column that was numeric until now with a list of strings. Cells
+// that were empty come back empty, kept cells as written and the rest in
+// shortest form.
+static Value demoteColumn(ObjMap* columns, Value name, ObjNumbers* numbers,
+                          CellTexts* texts) {
+    ObjList* list = newList();
+    push(OBJ_VAL(list));
+    reserveList(list, numbers->count + 1);
+    int kept = 0;
+    size_t start = 0;
+    for (int i = 0; i < numbers->count; i++) {
+        if (kept < texts->count && texts->cells[kept] == i) {
+            size_t end = texts->ends[kept++];
+            appendToList(list, OBJ_VAL(makeString(texts->chars + start, (int)(end - start))));
+            start = end;
+            continue;
+        }
+        char buffer[NUMBER_BUFFER_SIZE];
+        int length = cellText(numbers->items[i], buffer);
+        appendToList(list, OBJ_VAL(makeString(buffer, length)));
+    }
+    storeToMap(columns, name, OBJ_VAL(list));
+    pop();
+    freeCellTexts(texts);
+    return OBJ_VAL(list);
+}
+
+bool readCsvColumns(const char* path, Value* result, char* errMsg) {
+    CsvParser parser;
+    if (!openCsv(&parser, path)) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "readCsvColumns could not open '%s'.", path);
+        return false;
+    }
+
+    ObjMap* columns = newMap();
+    push(OBJ_VAL(columns));
+    RecordResult status;
+    while ((status = nextRecord(&parser)) == RECORD_READ && isBlankRecord(&parser)) {}
+
+    // Names and columns are also held by the map, which keeps them alive
+    int columnCount = status == RECORD_READ ? parser.fieldCount : 0;
+    Value* names = ALLOCATE(Value, columnCount);
+    Value* values = ALLOCATE(Value, columnCount);
+    CellTexts* texts = ALLOCATE(CellTexts, columnCount);
+    for (int i = 0; i < columnCount; i++) {
+        texts[i] = (CellTexts){NULL, 0, 0, NULL, NULL, 0, 0};
+    }
+    bool failed = false;
+    for (int i = 0; i < columnCount && !failed; i++) {
+        CsvField* field = &parser.fields[i];
+        const char* chars = fieldChars(&parser, field);
+        names[i] = OBJ_VAL(copyString(chars, field->length));
+        push(names[i]);
+        Value existing;
+        if (indexFromMap(columns, names[i], &existing)) {
+            snprintf(errMsg, NATIVE_ERROR_MAX, "readCsvColumns found the column name '%s' twice.",
+                     AS_CSTRING(names[i]));
+            failed = true;
+        } else {
+            values[i] = OBJ_VAL(newNumbers());
+            push(values[i]);
+            storeToMap(columns, names[i], values[i]);
+            pop();
+        }
+        pop();
+    }
+
+    while (!failed && status == RECORD_READ && (status = nextRecord(&parser)) == RECORD_READ) {
+        if (isBlankRecord(&parser)) continue;
+        if (parser.fieldCount > columnCount) {
+            snprintf(errMsg, NATIVE_ERROR_MAX,
+                     "readCsvColumns found more fields than columns in record %d.", parser.record);
+            failed = true;
+            break;
+        }
+        for (int i = 0; i < columnCount; i++) {
+            const char* chars = "";
+            int length = 0;
+            if (i < parser.fieldCount) {
+                chars = fieldChars(&parser, &parser.fields[i]);
+                length = parser.fields[i].length;
+            }
+            if (IS_NUMBERS(values[i])) {
+                double number = NAN;
+                if (length == 0 || parseNumber(chars, length, &number)) {
+                    ObjNumbers* numbers = AS_NUMBERS(values[i]);
+                    char buffer[NUMBER_BUFFER_SIZE];
+                    int formatted = cellText(number, buffer);
+                    if (formatted != length || memcmp(buffer, chars, length) != 0) {
+                        addCellText(&texts[i], numbers->count, chars, length);
+                    }
+                    appendToNumbers(numbers, number);
+                    continue;
+                }
+                values[i] = demoteColumn(columns, names[i], AS_NUMBERS(values[i]), &texts[i]);
+            }
+            Value string = OBJ_VAL(makeString(chars, length));
+            push(string);
+            appendToList(AS_LIST(values[i]), string);
+            pop();
+        }
+    }
+    if (status == RECORD_MALFORMED) {
+        snprintf(errMsg, NATIVE_ERROR_MAX,
+                 "readCsvColumns found a malformed quoted field in record %d.", parser.record + 1);
+        failed = true;
+    }
+    closeCsv(&parser);
+    FREE_ARRAY(Value, names, columnCount);
+    FREE_ARRAY(Value, values, columnCount);
+    for (int i = 0; i < columnCount; i++) freeCellTexts(&texts[i]);
+    FREE_ARRAY(CellTexts, texts, columnCount);
+
+    if (failed) {
+        pop();
+        return false;
+    }
+    *result = pop();
+    return true;
+}
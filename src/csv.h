@@ -0,0 +1,20 @@
+#ifndef nqq_csv_h
+#define nqq_csv_h
+
+#include "common.h"
+#include "value.h"
+
+// Reading CSV files a block at a time, so memory use is one block plus what
+// is returned. Fields may be quoted with doubled quotes inside and records
+// end in LF or CRLF. Blank lines are skipped.
+//
+// readCsvRows returns a list of rows that are each a list of strings.
+// readCsvColumns names columns after the first row and returns a map from
+// name to column. A column is a number array if every cell in it that isn't
+// empty is a number, with the empty ones read as nan, and otherwise a list of
+// each cell's text as written. Both return false and describe the problem in
+// errMsg, which needs NATIVE_ERROR_MAX bytes, if the file can't be read.
+bool readCsvRows(const char* path, Value* result, char* errMsg);
+bool readCsvColumns(const char* path, Value* result, char* errMsg);
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "debug.h"
 #include "object.h"
+#include "output.h"
 #include "value.h"
 
 #define TOTAL_WIDTH 50
@@ -30,12 +31,14 @@ static int constantInstruction(const char* name, Chunk* chunk, int offset) {
         constant |= chunk->code[offset + 2];
         printf("%-16s  [%5d]  ", name, constant);
         printValue(chunk->constants.values[constant]);
+        flushOutput();
         printf("\n");
         return offset + 3;
     } else {
         uint8_t constant = chunk->code[offset + 1];
         printf("%-16s  [%5d]  ", name, constant);
         printValue(chunk->constants.values[constant]);
+        flushOutput();
         printf("\n");
         return offset + 2;
     }
@@ -68,6 +71,16 @@ static int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset)
     return offset + 3;
 }
 
+static int fieldInstruction(const char* name, Chunk* chunk, int offset) {
+    uint16_t cache = (uint16_t)(chunk->code[offset + 1] << 8);
+    cache |= chunk->code[offset + 2];
+    printf("%-16s  [%5d]  ", name, cache);
+    printValue(OBJ_VAL(chunk->caches[cache].name));
+    flushOutput();
+    printf("\n");
+    return offset + 3;
+}
+
 static int wideInstruction(const char* name, int offset) {
     nextOpWide = true;
     printf("%-16s  [     ]\n", name);
@@ -145,6 +158,7 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             uint8_t constant = chunk->code[offset++];
             printf("%-16s  [%5d]  ", "OP_CLOSURE", constant);
             printValue(chunk->constants.values[constant]);
+            flushOutput();
             printf("\n");
 
             ObjFunction* function = AS_FUNCTION(
@@ -163,10 +177,16 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return byteInstruction("OP_BUILD_LIST", chunk, offset);
         case OP_BUILD_MAP:
             return byteInstruction("OP_BUILD_MAP", chunk, offset);
+        case OP_BUILD_STRING:
+            return byteInstruction("OP_BUILD_STRING", chunk, offset);
         case OP_INDEX_SUBSCR:
             return simpleInstruction("OP_INDEX_SUBSCR", offset);
         case OP_STORE_SUBSCR:
             return simpleInstruction("OP_STORE_SUBSCR", offset);
+        case OP_GET_FIELD:
+            return fieldInstruction("OP_GET_FIELD", chunk, offset);
+        case OP_SET_FIELD:
+            return fieldInstruction("OP_SET_FIELD", chunk, offset);
         case OP_WIDE:
             return wideInstruction("OP_WIDE", offset);
         case OP_RETURN:
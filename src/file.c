@@ -0,0 +1,110 @@
+#define _POSIX_C_SOURCE 200809L // For open, fstat and mmap
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file.h"
+#include "object.h"
+
+bool readWholeFile(const char* path, ObjString** result) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size > INT32_MAX) {
+        close(fd);
+        return false;
+    }
+
+    // Read straight into the string so the contents are only copied once
+    ObjString* string = newString((int)info.st_size);
+    int length = 0;
+    while (length < string->length) {
+        ssize_t count = read(fd, string->chars + length, string->length - length);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) break;
+        length += (int)count;
+    }
+    close(fd);
+    if (length < string->length) return false;
+
+    *result = string;
+    return true;
+}
+
+bool writeWholeFile(const char* path, const char* chars, size_t length) {
+    int fd = createDescriptor(path);
+    if (fd < 0) return false;
+    bool written = writeDescriptor(fd, chars, length);
+    return closeDescriptor(fd) && written;
+}
+
+// Maps the file read-only. Pages are loaded by the kernel as they are touched
+// and can be dropped again under memory pressure, so even files bigger than
+// memory can be scanned. An empty file gets no mapping.
+bool mapFile(const char* path, char** chars, size_t* length) {
+    static char empty[1] = "";
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return false;
+    }
+
+    *length = (size_t)info.st_size;
+    *chars = empty;
+    if (*length > 0) {
+        void* mapping = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        *chars = mapping;
+    }
+    // The mapping stays valid without the descriptor
+    close(fd);
+    return true;
+}
+
+void unmapFile(char* chars, size_t length) {
+    if (length > 0) munmap(chars, length);
+}
+
+// Returns a descriptor for reading path or -1.
+int openDescriptor(const char* path) {
+    return open(path, O_RDONLY);
+}
+
+// Returns a descriptor for writing path from scratch or -1.
+int createDescriptor(const char* path) {
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+}
+
+bool writeDescriptor(int fd, const char* chars, size_t length) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t count = write(fd, chars + written, length - written);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        written += (size_t)count;
+    }
+    return true;
+}
+
+bool closeDescriptor(int fd) {
+    return close(fd) == 0;
+}
+
+// Whether both paths name the same existing file, so writing one would
+// truncate the other out from under a mapping.
+bool isSameFile(const char* path, const char* otherPath) {
+    struct stat info, otherInfo;
+    if (stat(path, &info) != 0 || stat(otherPath, &otherInfo) != 0) return false;
+    return info.st_dev == otherInfo.st_dev && info.st_ino == otherInfo.st_ino;
+}
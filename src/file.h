@@ -0,0 +1,19 @@
+#ifndef nqq_file_h
+#define nqq_file_h
+
+#include "common.h"
+#include "value.h"
+
+// Whole-file operations behind the file natives. Each returns false if the
+// file couldn't be opened or fully read or written.
+bool readWholeFile(const char* path, ObjString** result);
+bool writeWholeFile(const char* path, const char* chars, size_t length);
+bool mapFile(const char* path, char** chars, size_t* length);
+void unmapFile(char* chars, size_t length);
+int openDescriptor(const char* path);
+int createDescriptor(const char* path);
+bool writeDescriptor(int fd, const char* chars, size_t length);
+bool closeDescriptor(int fd);
+bool isSameFile(const char* path, const char* otherPath);
+
+#endif
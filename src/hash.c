@@ -0,0 +1,530 @@
+#include <string.h>
+
+#include "hash.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HASH_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static uint32_t readLE32(const uint8_t* bytes) {
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 |
+           (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static uint64_t readLE64(const uint8_t* bytes) {
+    return (uint64_t)readLE32(bytes) | (uint64_t)readLE32(bytes + 4) << 32;
+}
+
+static uint32_t readBE32(const uint8_t* bytes) {
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+           (uint32_t)bytes[2] << 8 | (uint32_t)bytes[3];
+}
+
+static uint32_t rotl32(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static uint32_t rotr32(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static uint64_t rotl64(uint64_t x, int n) {
+    return (x << n) | (x >> (64 - n));
+}
+
+#ifdef HASH_X86
+static bool cpuChecked = false;
+static bool cpuHasClmul = false;
+static bool cpuHasSha = false;
+
+static void checkCpu() {
+    unsigned int a, b, c, d;
+    if (__get_cpuid(1, &a, &b, &c, &d)) {
+        bool sse = (c & bit_SSSE3) && (c & bit_SSE4_1);
+        cpuHasClmul = sse && (c & bit_PCLMUL);
+        if (__get_cpuid_count(7, 0, &a, &b, &c, &d)) cpuHasSha = sse && (b & bit_SHA);
+    }
+    cpuChecked = true;
+}
+#endif
+
+// CRC-32 as used by zlib, gzip and PNG: polynomial 0xEDB88320 reflected.
+// Both versions work on the running value with its bits flipped.
+
+static uint32_t crcTable[8][256];
+static bool crcTableReady = false;
+
+static void fillCrcTable() {
+    for (int i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        crcTable[0][i] = crc;
+    }
+    // Later tables advance a byte's contribution by further zero bytes so
+    // eight can be looked up independently
+    for (int i = 0; i < 256; i++) {
+        for (int table = 1; table < 8; table++) {
+            uint32_t previous = crcTable[table - 1][i];
+            crcTable[table][i] = (previous >> 8) ^ crcTable[0][previous & 0xFF];
+        }
+    }
+    crcTableReady = true;
+}
+
+static uint32_t crc32Portable(uint32_t crc, const uint8_t* bytes, size_t length) {
+    while (length >= 8) {
+        uint32_t low = readLE32(bytes) ^ crc;
+        uint32_t high = readLE32(bytes + 4);
+        crc = crcTable[7][low & 0xFF] ^ crcTable[6][(low >> 8) & 0xFF] ^
+              crcTable[5][(low >> 16) & 0xFF] ^ crcTable[4][low >> 24] ^
+              crcTable[3][high & 0xFF] ^ crcTable[2][(high >> 8) & 0xFF] ^
+              crcTable[1][(high >> 16) & 0xFF] ^ crcTable[0][high >> 24];
+        bytes += 8;
+        length -= 8;
+    }
+    while (length-- > 0) crc = (crc >> 8) ^ crcTable[0][(crc ^ *bytes++) & 0xFF];
+    return crc;
+}
+
+#ifdef HASH_X86
+// Folds four 16 byte lanes forward 64 bytes at a time with carry-less
+// multiplies, then folds them to one and Barrett reduces it to 32 bits. The
+// constants are powers of x modulo the polynomial. Takes at least 64 bytes in
+// a multiple of 16.
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32Clmul(uint32_t crc, const uint8_t* bytes, size_t length) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_loadu_si128((const __m128i*)(bytes + 0x00));
+    __m128i x2 = _mm_loadu_si128((const __m128i*)(bytes + 0x10));
+    __m128i x3 = _mm_loadu_si128((const __m128i*)(bytes + 0x20));
+    __m128i x4 = _mm_loadu_si128((const __m128i*)(bytes + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    bytes += 64;
+    length -= 64;
+
+    while (length >= 64) {
+        __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(bytes + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(bytes + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(bytes + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(bytes + 0x30)));
+        bytes += 64;
+        length -= 64;
+    }
+
+    __m128i lanes[3] = {x2, x3, x4};
+    for (int i = 0; i < 3; i++) {
+        __m128i low = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, lanes[i]), low);
+    }
+    while (length >= 16) {
+        __m128i low = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)bytes)), low);
+        bytes += 16;
+        length -= 16;
+    }
+
+    // 128 bits to 64
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // 64 bits to 32
+    x2 = _mm_and_si128(x1, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+#endif
+
+uint32_t computeCrc32(const char* chars, size_t length) {
+    return updateCrc32(0, chars, length);
+}
+
+uint32_t updateCrc32(uint32_t crc, const char* chars, size_t length) {
+    if (!crcTableReady) fillCrcTable();
+    const uint8_t* bytes = (const uint8_t*)chars;
+    crc = ~crc;
+#ifdef HASH_X86
+    if (!cpuChecked) checkCpu();
+    if (cpuHasClmul && length >= 64) {
+        size_t folded = length & ~(size_t)15;
+        crc = crc32Clmul(crc, bytes, folded);
+        bytes += folded;
+        length -= folded;
+    }
+#endif
+    return ~crc32Portable(crc, bytes, length);
+}
+
+// xxHash64. Its four independent lanes already keep a core's multipliers
+// busy, so there's no SIMD version.
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3 0x165667B19E3779F9ULL
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5 0x27D4EB2F165667C5ULL
+
+static uint64_t xxhRound(uint64_t accumulator, uint64_t input) {
+    accumulator += input * XXH_PRIME2;
+    return rotl64(accumulator, 31) * XXH_PRIME1;
+}
+
+static uint64_t xxhMerge(uint64_t hash, uint64_t lane) {
+    hash ^= xxhRound(0, lane);
+    return hash * XXH_PRIME1 + XXH_PRIME4;
+}
+
+uint64_t computeXxhash64(const char* chars, size_t length, uint64_t seed) {
+    const uint8_t* bytes = (const uint8_t*)chars;
+    const uint8_t* end = bytes + length;
+    uint64_t hash;
+
+    if (length >= 32) {
+        uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+        uint64_t v2 = seed + XXH_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME1;
+        do {
+            v1 = xxhRound(v1, readLE64(bytes));
+            v2 = xxhRound(v2, readLE64(bytes + 8));
+            v3 = xxhRound(v3, readLE64(bytes + 16));
+            v4 = xxhRound(v4, readLE64(bytes + 24));
+            bytes += 32;
+        } while (end - bytes >= 32);
+        hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        hash = xxhMerge(hash, v1);
+        hash = xxhMerge(hash, v2);
+        hash = xxhMerge(hash, v3);
+        hash = xxhMerge(hash, v4);
+    } else {
+        hash = seed + XXH_PRIME5;
+    }
+    hash += length;
+
+    while (end - bytes >= 8) {
+        hash ^= xxhRound(0, readLE64(bytes));
+        hash = rotl64(hash, 27) * XXH_PRIME1 + XXH_PRIME4;
+        bytes += 8;
+    }
+    if (end - bytes >= 4) {
+        hash ^= (uint64_t)readLE32(bytes) * XXH_PRIME1;
+        hash = rotl64(hash, 23) * XXH_PRIME2 + XXH_PRIME3;
+        bytes += 4;
+    }
+    while (bytes < end) {
+        hash ^= *bytes++ * XXH_PRIME5;
+        hash = rotl64(hash, 11) * XXH_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// xxHash32, the 32-bit sibling, kept incrementally. Whole stripes of 16
+// bytes go through the lanes and the rest waits in pending.
+
+#define XXH32_PRIME1 0x9E3779B1U
+#define XXH32_PRIME2 0x85EBCA77U
+#define XXH32_PRIME3 0xC2B2AE3DU
+#define XXH32_PRIME4 0x27D4EB2FU
+#define XXH32_PRIME5 0x165667B1U
+
+static uint32_t xxh32Round(uint32_t accumulator, uint32_t input) {
+    accumulator += input * XXH32_PRIME2;
+    return rotl32(accumulator, 13) * XXH32_PRIME1;
+}
+
+static void xxh32Stripe(uint32_t lanes[4], const uint8_t* bytes) {
+    lanes[0] = xxh32Round(lanes[0], readLE32(bytes));
+    lanes[1] = xxh32Round(lanes[1], readLE32(bytes + 4));
+    lanes[2] = xxh32Round(lanes[2], readLE32(bytes + 8));
+    lanes[3] = xxh32Round(lanes[3], readLE32(bytes + 12));
+}
+
+void startXxhash32(Xxhash32* state, uint32_t seed) {
+    state->lanes[0] = seed + XXH32_PRIME1 + XXH32_PRIME2;
+    state->lanes[1] = seed + XXH32_PRIME2;
+    state->lanes[2] = seed;
+    state->lanes[3] = seed - XXH32_PRIME1;
+    state->pendingCount = 0;
+    state->length = 0;
+    state->seed = seed;
+}
+
+void updateXxhash32(Xxhash32* state, const char* chars, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)chars;
+    state->length += length;
+    if (state->pendingCount > 0) {
+        size_t count = 16 - state->pendingCount;
+        if (count > length) count = length;
+        memcpy(state->pending + state->pendingCount, bytes, count);
+        state->pendingCount += (int)count;
+        bytes += count;
+        length -= count;
+        if (state->pendingCount < 16) return;
+        xxh32Stripe(state->lanes, state->pending);
+        state->pendingCount = 0;
+    }
+    uint32_t lanes[4] = {state->lanes[0], state->lanes[1], state->lanes[2], state->lanes[3]};
+    for (; length >= 16; bytes += 16, length -= 16) xxh32Stripe(lanes, bytes);
+    memcpy(state->lanes, lanes, sizeof(lanes));
+    memcpy(state->pending, bytes, length);
+    state->pendingCount = (int)length;
+}
+
+uint32_t finishXxhash32(Xxhash32* state) {
+    uint32_t hash;
+    if (state->length >= 16) {
+        hash = rotl32(state->lanes[0], 1) + rotl32(state->lanes[1], 7) +
+               rotl32(state->lanes[2], 12) + rotl32(state->lanes[3], 18);
+    } else {
+        hash = state->seed + XXH32_PRIME5;
+    }
+    hash += (uint32_t)state->length;
+
+    const uint8_t* bytes = state->pending;
+    const uint8_t* end = bytes + state->pendingCount;
+    for (; end - bytes >= 4; bytes += 4) {
+        hash += readLE32(bytes) * XXH32_PRIME3;
+        hash = rotl32(hash, 17) * XXH32_PRIME4;
+    }
+    while (bytes < end) {
+        hash += *bytes++ * XXH32_PRIME5;
+        hash = rotl32(hash, 11) * XXH32_PRIME1;
+    }
+
+    hash ^= hash >> 15;
+    hash *= XXH32_PRIME2;
+    hash ^= hash >> 13;
+    hash *= XXH32_PRIME3;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+// SHA-256
+
+static const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void sha256Portable(uint32_t state[8], const uint8_t* bytes, size_t blocks) {
+    for (; blocks > 0; blocks--, bytes += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) w[i] = readBE32(bytes + i * 4);
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+            uint32_t choice = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + choice + sha256K[i] + w[i];
+            uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + majority;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef HASH_X86
+// The SHA instructions keep the state as ABEF and CDGH halves and do two
+// rounds each; the message schedule advances four words at a time.
+__attribute__((target("sha,ssse3,sse4.1")))
+static void sha256Native(uint32_t state[8], const uint8_t* bytes, size_t blocks) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; blocks > 0; blocks--, bytes += 64) {
+        __m128i abefSave = state0;
+        __m128i cdghSave = state1;
+        __m128i schedule[4];
+        for (int group = 0; group < 16; group++) {
+            __m128i words;
+            if (group < 4) {
+                words = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(bytes + group * 16)),
+                                         byteSwap);
+            } else {
+                __m128i previous = schedule[(group - 1) & 3];
+                words = _mm_sha256msg1_epu32(schedule[group & 3], schedule[(group - 3) & 3]);
+                words = _mm_add_epi32(words, _mm_alignr_epi8(previous, schedule[(group - 2) & 3], 4));
+                words = _mm_sha256msg2_epu32(words, previous);
+            }
+            schedule[group & 3] = words;
+            __m128i message = _mm_add_epi32(words,
+                                            _mm_loadu_si128((const __m128i*)&sha256K[group * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(message, 0x0E));
+        }
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i*)&state[0], state0);
+    _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+#endif
+
+static void sha256Blocks(uint32_t state[8], const uint8_t* bytes, size_t blocks) {
+#ifdef HASH_X86
+    if (!cpuChecked) checkCpu();
+    if (cpuHasSha) {
+        sha256Native(state, bytes, blocks);
+        return;
+    }
+#endif
+    sha256Portable(state, bytes, blocks);
+}
+
+// Copies the tail into one or two padded blocks ending in the bit length,
+// big or little endian.
+static size_t padFinal(uint8_t final[128], const uint8_t* tail, size_t tailLength,
+                       size_t length, bool bigEndian) {
+    memset(final, 0, 128);
+    if (tailLength > 0) memcpy(final, tail, tailLength);
+    final[tailLength] = 0x80;
+    size_t blocks = tailLength < 56 ? 1 : 2;
+    uint64_t bits = (uint64_t)length * 8;
+    for (int i = 0; i < 8; i++) {
+        int shift = bigEndian ? 56 - i * 8 : i * 8;
+        final[blocks * 64 - 8 + i] = (uint8_t)(bits >> shift);
+    }
+    return blocks;
+}
+
+void computeSha256(const char* chars, size_t length, uint8_t digest[32]) {
+    uint32_t state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    const uint8_t* bytes = (const uint8_t*)chars;
+    size_t whole = length / 64;
+    if (whole > 0) sha256Blocks(state, bytes, whole);
+
+    uint8_t final[128];
+    size_t blocks = padFinal(final, bytes + whole * 64, length % 64, length, true);
+    sha256Blocks(state, final, blocks);
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = (uint8_t)(state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)state[i];
+    }
+}
+
+// MD5, for matching existing checksums rather than anything needing security
+
+static const uint32_t md5K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+#define MD5_STEP(f, word, shift) \
+    do { \
+        uint32_t rotated = rotl32(a + (f) + md5K[i] + m[word], shift); \
+        a = d; \
+        d = c; \
+        c = b; \
+        b += rotated; \
+    } while (false)
+
+static void md5Blocks(uint32_t state[4], const uint8_t* bytes, size_t blocks) {
+    static const int shifts[4][4] = {
+        {7, 12, 17, 22}, {5, 9, 14, 20}, {4, 11, 16, 23}, {6, 10, 15, 21},
+    };
+    for (; blocks > 0; blocks--, bytes += 64) {
+        uint32_t m[16];
+        for (int i = 0; i < 16; i++) m[i] = readLE32(bytes + i * 4);
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        int i = 0;
+        for (; i < 16; i++) MD5_STEP((b & c) | (~b & d), i, shifts[0][i & 3]);
+        for (; i < 32; i++) MD5_STEP((d & b) | (~d & c), (5 * i + 1) & 15, shifts[1][i & 3]);
+        for (; i < 48; i++) MD5_STEP(b ^ c ^ d, (3 * i + 5) & 15, shifts[2][i & 3]);
+        for (; i < 64; i++) MD5_STEP(c ^ (b | ~d), (7 * i) & 15, shifts[3][i & 3]);
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
+}
+
+void computeMd5(const char* chars, size_t length, uint8_t digest[16]) {
+    uint32_t state[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    const uint8_t* bytes = (const uint8_t*)chars;
+    size_t whole = length / 64;
+    if (whole > 0) md5Blocks(state, bytes, whole);
+
+    uint8_t final[128];
+    size_t blocks = padFinal(final, bytes + whole * 64, length % 64, length, false);
+    md5Blocks(state, final, blocks);
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) digest[i * 4 + j] = (uint8_t)(state[i] >> (j * 8));
+    }
+}
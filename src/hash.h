@@ -0,0 +1,30 @@
+#ifndef nqq_hash_h
+#define nqq_hash_h
+
+#include "common.h"
+
+// Checksums and digests of raw bytes. CRC-32 folds 64 bytes at a time with
+// carry-less multiplies and SHA-256 uses the SHA instructions when the CPU has
+// them, checked once at runtime; both fall back to portable code otherwise.
+uint32_t computeCrc32(const char* chars, size_t length);
+// Continues a CRC-32 over more bytes, where crc is the value for the bytes
+// before them, or 0 for none.
+uint32_t updateCrc32(uint32_t crc, const char* chars, size_t length);
+uint64_t computeXxhash64(const char* chars, size_t length, uint64_t seed);
+void computeSha256(const char* chars, size_t length, uint8_t digest[32]);
+void computeMd5(const char* chars, size_t length, uint8_t digest[16]);
+
+// xxHash32 over bytes that arrive in pieces, as LZ4 frames need.
+typedef struct {
+    uint32_t lanes[4];
+    uint8_t pending[16];
+    int pendingCount;
+    uint64_t length;
+    uint32_t seed;
+} Xxhash32;
+
+void startXxhash32(Xxhash32* state, uint32_t seed);
+void updateXxhash32(Xxhash32* state, const char* chars, size_t length);
+uint32_t finishXxhash32(Xxhash32* state);
+
+#endif
@@ -0,0 +1,636 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "json.h"
+#include "memory.h"
+#include "number.h"
+#include "object.h"
+#include "vm.h"
+
+// Parsing takes two passes like simdjson (Langdale and Lemire, "Parsing
+// Gigabytes of JSON per Second"). The first classifies 64 bytes at a time and
+// records where every structural character, string and scalar starts, with
+// everything inside strings masked out. The second walks those positions and
+// builds the values.
+
+typedef struct {
+    const char* chars;
+    int length;
+    uint32_t* structurals;  // Positions found by the first pass
+    int count;
+    int current;            // Next entry of structurals to parse
+    char* scratch;          // Holds strings while their escapes are decoded
+    int scratchCapacity;
+    int depth;
+    const char* error;
+    int errorPosition;
+} JsonParser;
+
+// Bit i of each mask is set if byte i of a 64 byte block is that character.
+typedef struct {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;            // { } [ ] : ,
+    uint64_t space;
+} BlockMasks;
+
+#ifdef __SSE2__
+static uint64_t matchBytes(const __m128i* chunks, char c) {
+    __m128i target = _mm_set1_epi8(c);
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; i++) {
+        uint16_t bits = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunks[i], target));
+        mask |= (uint64_t)bits << (16 * i);
+    }
+    return mask;
+}
+#endif
+
+static void classifyBlock(const char* block, BlockMasks* masks) {
+#ifdef __SSE2__
+    __m128i chunks[4];
+    for (int i = 0; i < 4; i++) {
+        chunks[i] = _mm_loadu_si128((const __m128i*)(block + 16 * i));
+    }
+    masks->quote = matchBytes(chunks, '"');
+    masks->backslash = matchBytes(chunks, '\\');
+    masks->op = matchBytes(chunks, '{') | matchBytes(chunks, '}') |
+                matchBytes(chunks, '[') | matchBytes(chunks, ']') |
+                matchBytes(chunks, ':') | matchBytes(chunks, ',');
+    masks->space = matchBytes(chunks, ' ') | matchBytes(chunks, '\t') |
+                   matchBytes(chunks, '\n') | matchBytes(chunks, '\r');
+#else
+    masks->quote = masks->backslash = masks->op = masks->space = 0;
+    for (int i = 0; i < 64; i++) {
+        uint64_t bit = 1ULL << i;
+        switch (block[i]) {
+            case '"': masks->quote |= bit; break;
+            case '\\': masks->backslash |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                masks->op |= bit;
+                break;
+            case ' ': case '\t': case '\n': case '\r':
+                masks->space |= bit;
+                break;
+        }
+    }
+#endif
+}
+
+// Bit i of the result is the parity of bits 0 to i, so a run of set bits
+// between each pair of quotes.
+static uint64_t prefixXor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+static bool fail(JsonParser* parser, const char* message) {
+    if (parser->error == NULL) {
+        parser->error = message;
+        parser->errorPosition = parser->current < parser->count ?
+            (int)parser->structurals[parser->current] : parser->length;
+    }
+    return false;
+}
+
+static bool findStructurals(JsonParser* parser) {
+    parser->structurals = ALLOCATE(uint32_t, parser->length + 1);
+
+    uint64_t inStringCarry = 0;     // All ones if the last block ended in a string
+    bool escapeCarry = false;       // Last block ended with an escaping backslash
+    uint64_t boundaryCarry = 1;     // Last byte ended a token
+    char padded[64];
+    for (int base = 0; base < parser->length; base += 64) {
+        const char* block = parser->chars + base;
+        if (parser->length - base < 64) {
+            memset(padded, ' ', sizeof(padded));
+            memcpy(padded, block, parser->length - base);
+            block = padded;
+        }
+        BlockMasks masks;
+        classifyBlock(block, &masks);
+
+        // Backslashes are rare enough that walking the bits is fine
+        uint64_t escaped = 0;
+        if (masks.backslash != 0 || escapeCarry) {
+            for (int i = 0; i < 64; i++) {
+                uint64_t bit = 1ULL << i;
+                if (escapeCarry) {
+                    escaped |= bit;
+                    escapeCarry = false;
+                } else if (masks.backslash & bit) {
+                    escapeCarry = true;
+                }
+            }
+        }
+
+        uint64_t quotes = masks.quote & ~escaped;
+        // Set from an opening quote up to but not including its closing quote
+        uint64_t inString = prefixXor(quotes) ^ inStringCarry;
+        inStringCarry = (uint64_t)((int64_t)inString >> 63);
+
+        uint64_t tokenEnds = masks.op | masks.space | quotes;
+        uint64_t scalars = ~(masks.op | masks.space | masks.quote) & ~inString;
+        uint64_t scalarStarts = scalars & ((tokenEnds << 1) | boundaryCarry);
+        boundaryCarry = tokenEnds >> 63;
+
+        uint64_t structural = (masks.op & ~inString) | (quotes & inString) | scalarStarts;
+        while (structural != 0) {
+            parser->structurals[parser->count++] = base + __builtin_ctzll(structural);
+            structural &= structural - 1;
+        }
+    }
+
+    if (inStringCarry != 0) {
+        // Nothing inside the string was recorded so its quote came last
+        parser->current = parser->count - 1;
+        return fail(parser, "found an unterminated string");
+    }
+    return true;
+}
+
+// Returns the index of the first byte at or after start that a string can't
+// hold as is: a quote, a backslash or a control character.
+static int skipPlainChars(const char* chars, int length, int start) {
+    int i = start;
+#ifdef __SSE2__
+    __m128i quote = _mm_set1_epi8('"');
+    __m128i backslash = _mm_set1_epi8('\\');
+    __m128i control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(chars + i));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(block, quote),
+                                       _mm_cmpeq_epi8(block, backslash));
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(block, control), block));
+        int mask = _mm_movemask_epi8(special);
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < length; i++) {
+        unsigned char c = (unsigned char)chars[i];
+        if (c == '"' || c == '\\' || c < 0x20) return i;
+    }
+    return length;
+}
+
+static void appendScratch(JsonParser* parser, int* length, const char* chars, int count) {
+    if (parser->scratchCapacity < *length + count) {
+        int oldCapacity = parser->scratchCapacity;
+        int capacity = oldCapacity < 8 ? 8 : oldCapacity;
+        while (capacity < *length + count) capacity *= 2;
+        parser->scratch = GROW_ARRAY(parser->scratch, char, oldCapacity, capacity);
+        parser->scratchCapacity = capacity;
+    }
+    memcpy(parser->scratch + *length, chars, count);
+    *length += count;
+}
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Reads the four hex digits after a "\u" at i or returns -1.
+static int readHex4(JsonParser* parser, int i) {
+    if (i + 4 > parser->length) return -1;
+    int value = 0;
+    for (int j = 0; j < 4; j++) {
+        int digit = hexDigit(parser->chars[i + j]);
+        if (digit < 0) return -1;
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+static int encodeUtf8(int codepoint, char* out) {
+    if (codepoint < 0x80) {
+        out[0] = (char)codepoint;
+        return 1;
+    } else if (codepoint < 0x800) {
+        out[0] = (char)(0xC0 | (codepoint >> 6));
+        out[1] = (char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    } else if (codepoint < 0x10000) {
+        out[0] = (char)(0xE0 | (codepoint >> 12));
+        out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (codepoint >> 18));
+    out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+// Parses the string whose opening quote is the current structural. Keys are
+// interned since they are looked up by name.
+static bool parseString(JsonParser* parser, bool isKey, ObjString** result) {
+    const char* chars = parser->chars;
+    int start = parser->structurals[parser->current] + 1;
+    int i = skipPlainChars(chars, parser->length, start);
+
+    if (i < parser->length && chars[i] == '"') {
+        // Nothing to decode so the string is copied straight from the source
+        *result = isKey ? copyString(chars + start, i - start)
+                        : makeString(chars + start, i - start);
+        parser->current++;
+        return true;
+    }
+
+    int length = 0;
+    appendScratch(parser, &length, chars + start, i - start);
+    for (;;) {
+        if (i >= parser->length) return fail(parser, "found an unterminated string");
+        char c = chars[i];
+        if (c == '"') break;
+        if (c != '\\') return fail(parser, "found a control character in a string");
+
+        char decoded[4];
+        int decodedLength = 1;
+        switch (i + 1 < parser->length ? chars[i + 1] : '\0') {
+            case '"':  decoded[0] = '"'; break;
+            case '\\': decoded[0] = '\\'; break;
+            case '/':  decoded[0] = '/'; break;
+            case 'b':  decoded[0] = '\b'; break;
+            case 'f':  decoded[0] = '\f'; break;
+            case 'n':  decoded[0] = '\n'; break;
+            case 'r':  decoded[0] = '\r'; break;
+            case 't':  decoded[0] = '\t'; break;
+            case 'u': {
+                int codepoint = readHex4(parser, i + 2);
+                if (codepoint < 0) return fail(parser, "found an invalid \\u escape");
+                i += 4;
+                if (codepoint >= 0xD800 && codepoint <= 0xDBFF &&
+                    i + 3 < parser->length && chars[i + 2] == '\\' && chars[i + 3] == 'u') {
+                    int low = readHex4(parser, i + 4);
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    }
+                }
+                // A surrogate without its other half can't be encoded
+                if (codepoint >= 0xD800 && codepoint <= 0xDFFF) codepoint = 0xFFFD;
+                decodedLength = encodeUtf8(codepoint, decoded);
+                break;
+            }
+            default:
+                return fail(parser, "found an invalid escape");
+        }
+        appendScratch(parser, &length, decoded, decodedLength);
+        i += 2;
+
+        int next = skipPlainChars(chars, parser->length, i);
+        appendScratch(parser, &length, chars + i, next - i);
+        i = next;
+    }
+
+    *result = isKey ? copyString(parser->scratch, length)
+                    : makeString(parser->scratch, length);
+    parser->current++;
+    return true;
+}
+
+static bool isBoundary(char c) {
+    switch (c) {
+        case ' ': case '\t': case '\n': case '\r':
+        case ',': case ':': case '[': case ']': case '{': case '}':
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool parseJsonNumber(JsonParser* parser, Value* value) {
+    const char* chars = parser->chars;
+    int start = parser->structurals[parser->current];
+    int i = start;
+
+    // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    if (chars[i] == '-') i++;
+    if (i < parser->length && chars[i] == '0') {
+        i++;
+    } else if (i < parser->length && isDigit(chars[i])) {
+        while (i < parser->length && isDigit(chars[i])) i++;
+    } else {
+        return fail(parser, "found an invalid number");
+    }
+    if (i < parser->length && chars[i] == '.') {
+        i++;
+        if (i >= parser->length || !isDigit(chars[i])) return fail(parser, "found an invalid number");
+        while (i < parser->length && isDigit(chars[i])) i++;
+    }
+    if (i < parser->length && (chars[i] == 'e' || chars[i] == 'E')) {
+        i++;
+        if (i < parser->length && (chars[i] == '+' || chars[i] == '-')) i++;
+        if (i >= parser->length || !isDigit(chars[i])) return fail(parser, "found an invalid number");
+        while (i < parser->length && isDigit(chars[i])) i++;
+    }
+    if (i < parser->length && !isBoundary(chars[i])) return fail(parser, "found an invalid number");
+
+    double number;
+    parseNumber(chars + start, i - start, &number);
+    *value = NUMBER_VAL(number);
+    parser->current++;
+    return true;
+}
+
+static bool parseLiteral(JsonParser* parser, const char* text, Value literal, Value* value) {
+    int start = parser->structurals[parser->current];
+    int length = (int)strlen(text);
+    if (parser->length - start < length || memcmp(parser->chars + start, text, length) != 0 ||
+        (start + length < parser->length && !isBoundary(parser->chars[start + length]))) {
+        return fail(parser, "found an unexpected character");
+    }
+    *value = literal;
+    parser->current++;
+    return true;
+}
+
+static char currentChar(JsonParser* parser) {
+    if (parser->current >= parser->count) return '\0';
+    return parser->chars[parser->structurals[parser->current]];
+}
+
+static bool parseValue(JsonParser* parser, Value* value);
+
+// Containers under construction sit on the VM stack so a collection in the
+// middle of a deep parse sees everything built so far.
+static bool parseArray(JsonParser* parser, Value* value) {
+    parser->current++;
+    ObjList* list = newList();
+    push(OBJ_VAL(list));
+
+    if (currentChar(parser) == ']') {
+        parser->current++;
+    } else {
+        for (;;) {
+            Value item;
+            if (!parseValue(parser, &item)) return false;
+            push(item);
+            appendToList(list, item);
+            pop();
+
+            char c = currentChar(parser);
+            if (c == ']') {
+                parser->current++;
+                break;
+            }
+            if (c != ',') return fail(parser, "expected ',' or ']'");
+            parser->current++;
+        }
+    }
+
+    *value = pop();
+    return true;
+}
+
+static bool parseObject(JsonParser* parser, Value* value) {
+    parser->current++;
+    ObjMap* map = newMap();
+    push(OBJ_VAL(map));
+
+    if (currentChar(parser) == '}') {
+        parser->current++;
+    } else {
+        for (;;) {
+            if (currentChar(parser) != '"') return fail(parser, "expected a string key");
+            ObjString* key;
+            if (!parseString(parser, true, &key)) return false;
+            push(OBJ_VAL(key));
+
+            if (currentChar(parser) != ':') return fail(parser, "expected ':'");
+            parser->current++;
+
+            Value item;
+            if (!parseValue(parser, &item)) return false;
+            push(item);
+            storeToMap(map, OBJ_VAL(key), item);
+            pop();
+            pop();
+
+            char c = currentChar(parser);
+            if (c == '}') {
+                parser->current++;
+                break;
+            }
+            if (c != ',') return fail(parser, "expected ',' or '}'");
+            parser->current++;
+        }
+    }
+
+    *value = pop();
+    return true;
+}
+
+static bool parseValue(JsonParser* parser, Value* value) {
+    switch (currentChar(parser)) {
+        case '\0':
+            if (parser->current >= parser->count) return fail(parser, "expected a value");
+            return fail(parser, "found an unexpected character");
+        case '[':
+        case '{': {
+            if (parser->depth == JSON_MAX_DEPTH) return fail(parser, "found nesting too deep");
+            parser->depth++;
+            bool parsed = currentChar(parser) == '[' ? parseArray(parser, value)
+                                                     : parseObject(parser, value);
+            parser->depth--;
+            return parsed;
+        }
+        case '"': {
+            ObjString* string;
+            if (!parseString(parser, false, &string)) return false;
+            *value = OBJ_VAL(string);
+            return true;
+        }
+        case 't': return parseLiteral(parser, "true", BOOL_VAL(true), value);
+        case 'f': return parseLiteral(parser, "false", BOOL_VAL(false), value);
+        case 'n': return parseLiteral(parser, "null", NIL_VAL, value);
+        default: {
+            char c = currentChar(parser);
+            if (c == '-' || isDigit(c)) return parseJsonNumber(parser, value);
+            return fail(parser, "found an unexpected character");
+        }
+    }
+}
+
+bool parseJson(ObjString* source, Value* result, char* errMsg) {
+    JsonParser parser;
+    parser.chars = source->chars;
+    parser.length = source->length;
+    parser.structurals = NULL;
+    parser.count = 0;
+    parser.current = 0;
+    parser.scratch = NULL;
+    parser.scratchCapacity = 0;
+    parser.depth = 0;
+    parser.error = NULL;
+    parser.errorPosition = 0;
+
+    // A failure can leave partly built containers on the stack
+    Value* stackTop = vm.stackTop;
+    if (findStructurals(&parser) && parseValue(&parser, result) &&
+        parser.current < parser.count) {
+        fail(&parser, "found more after the value");
+    }
+    vm.stackTop = stackTop;
+
+    FREE_ARRAY(uint32_t, parser.structurals, parser.length + 1);
+    FREE_ARRAY(char, parser.scratch, parser.scratchCapacity);
+
+    if (parser.error != NULL) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "jsonParse %s at byte %d.",
+                 parser.error, parser.errorPosition);
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    char* chars;
+    int length;
+    int capacity;
+} JsonWriter;
+
+static void reserveWriter(JsonWriter* writer, int count) {
+    if (writer->capacity < writer->length + count) {
+        int oldCapacity = writer->capacity;
+        int capacity = oldCapacity < 64 ? 64 : oldCapacity;
+        while (capacity < writer->length + count) capacity *= 2;
+        writer->chars = GROW_ARRAY(writer->chars, char, oldCapacity, capacity);
+        writer->capacity = capacity;
+    }
+}
+
+static void writeChars(JsonWriter* writer, const char* chars, int length) {
+    reserveWriter(writer, length);
+    memcpy(writer->chars + writer->length, chars, length);
+    writer->length += length;
+}
+
+static void writeJsonString(JsonWriter* writer, const char* chars, int length) {
+    writeChars(writer, "\"", 1);
+    int i = 0;
+    while (i < length) {
+        int next = skipPlainChars(chars, length, i);
+        writeChars(writer, chars + i, next - i);
+        if (next == length) break;
+
+        unsigned char c = (unsigned char)chars[next];
+        switch (c) {
+            case '"':  writeChars(writer, "\\\"", 2); break;
+            case '\\': writeChars(writer, "\\\\", 2); break;
+            case '\b': writeChars(writer, "\\b", 2); break;
+            case '\f': writeChars(writer, "\\f", 2); break;
+            case '\n': writeChars(writer, "\\n", 2); break;
+            case '\r': writeChars(writer, "\\r", 2); break;
+            case '\t': writeChars(writer, "\\t", 2); break;
+            default: {
+                char escape[7];
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                writeChars(writer, escape, 6);
+                break;
+            }
+        }
+        i = next + 1;
+    }
+    writeChars(writer, "\"", 1);
+}
+
+static void writeJsonNumber(JsonWriter* writer, double number) {
+    // JSON has no NaN or infinities
+    if (!isfinite(number)) {
+        writeChars(writer, "null", 4);
+        return;
+    }
+    reserveWriter(writer, NUMBER_BUFFER_SIZE);
+    writer->length += formatNumber(number, writer->chars + writer->length);
+}
+
+static bool writeJson(JsonWriter* writer, Value value, int depth, char* errMsg) {
+    if (depth > JSON_MAX_DEPTH) {
+        sprintf(errMsg, "jsonStringify found nesting too deep or a cycle.");
+        return false;
+    }
+
+    if (IS_NIL(value)) {
+        writeChars(writer, "null", 4);
+    } else if (IS_BOOL(value)) {
+        if (AS_BOOL(value)) {
+            writeChars(writer, "true", 4);
+        } else {
+            writeChars(writer, "false", 5);
+        }
+    } else if (IS_NUMBER(value)) {
+        writeJsonNumber(writer, AS_NUMBER(value));
+    } else if (IS_STRING(value)) {
+        ObjString* string = AS_STRING(value);
+        writeJsonString(writer, string->chars, string->length);
+    } else if (IS_LIST(value)) {
+        ObjList* list = AS_LIST(value);
+        writeChars(writer, "[", 1);
+        for (int i = 0; i < list->count; i++) {
+            if (i > 0) writeChars(writer, ",", 1);
+            if (!writeJson(writer, list->items[i], depth + 1, errMsg)) return false;
+        }
+        writeChars(writer, "]", 1);
+    } else if (IS_MAP(value)) {
+        ObjMap* map = AS_MAP(value);
+        writeChars(writer, "{", 1);
+        bool first = true;
+        int cursor = 0;
+        Value key, item;
+        while (nextInMap(map, &cursor, &key, &item)) {
+            if (!first) writeChars(writer, ",", 1);
+            first = false;
+            if (IS_STRING(key)) {
+                ObjString* string = AS_STRING(key);
+                writeJsonString(writer, string->chars, string->length);
+            } else if (IS_NUMBER(key)) {
+                char buffer[NUMBER_BUFFER_SIZE];
+                int length = formatNumber(AS_NUMBER(key), buffer);
+                writeJsonString(writer, buffer, length);
+            } else {
+                sprintf(errMsg, "jsonStringify expected map keys to be strings or numbers.");
+                return false;
+            }
+            writeChars(writer, ":", 1);
+            if (!writeJson(writer, item, depth + 1, errMsg)) return false;
+        }
+        writeChars(writer, "}", 1);
+    } else {
+        sprintf(errMsg, "jsonStringify expected only lists, maps, strings, numbers, bools and nil.");
+        return false;
+    }
+    return true;
+}
+
+bool stringifyJson(Value value, Value* result, char* errMsg) {
+    JsonWriter writer;
+    writer.chars = NULL;
+    writer.length = 0;
+    writer.capacity = 0;
+
+    bool written = writeJson(&writer, value, 0, errMsg);
+    if (written) {
+        *result = OBJ_VAL(makeString(writer.chars, writer.length));
+    }
+    FREE_ARRAY(char, writer.chars, writer.capacity);
+    return written;
+}
@@ -0,0 +1,16 @@
+#ifndef nqq_json_h
+#define nqq_json_h
+
+#include "common.h"
+#include "value.h"
+
+// Deepest nesting of arrays and objects either direction handles
+#define JSON_MAX_DEPTH 512
+
+// Both return false and describe the problem in errMsg, which needs
+// NATIVE_ERROR_MAX bytes, if the conversion fails. The source string and
+// value are expected to be reachable by the GC i.e. on the stack.
+bool parseJson(ObjString* source, Value* result, char* errMsg);
+bool stringifyJson(Value value, Value* result, char* errMsg);
+
+#endif
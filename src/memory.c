@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "compiler.h"
+#include "file.h"
 #include "memory.h"
 #include "vm.h"
 
@@ -35,8 +36,10 @@ void markObject(Obj* object) {
     if (object == NULL) return;
     if (object->isMarked) return;
 #ifdef DEBUG_LOG_GC
+    flushOutput();
     printf("%p mark ", (void*)object);
     printValue(OBJ_VAL(object));
+    flushOutput();
     printf("\n");
 #endif
     object->isMarked = true;
@@ -64,8 +67,10 @@ static void markArray(ValueArray* array) {
 
 static void blackenObject(Obj* object) {
 #ifdef DEBUG_LOG_GC
+    flushOutput();
     printf("%p blacken ", (void*)object);
     printValue(OBJ_VAL(object));
+    flushOutput();
     printf("\n");
 #endif
     switch (object->type) {
@@ -81,6 +86,10 @@ static void blackenObject(Obj* object) {
             ObjFunction* function = (ObjFunction*)object;
             markObject((Obj*)function->name);
             markArray(&function->chunk.constants);
+            for (int i = 0; i < function->chunk.cacheCount; i++) {
+                markObject((Obj*)function->chunk.caches[i].name);
+                markObject((Obj*)function->chunk.caches[i].shape);
+            }
             break;
         }
         case OBJ_UPVALUE: {
@@ -96,10 +105,44 @@ static void blackenObject(Obj* object) {
         }
         case OBJ_MAP: {
             ObjMap* map = (ObjMap*)object;
+            markObject((Obj*)map->shape);
+            for (int i = 0; i < map->arrayLength; i++) {
+                markValue(map->array[i]);
+            }
             markTable(&map->items);
             break;
         }
+        case OBJ_ROPE: {
+            ObjRope* rope = (ObjRope*)object;
+            markObject(rope->left);
+            markObject(rope->right);
+            markObject((Obj*)rope->flat);
+            break;
+        }
+        case OBJ_SET: {
+            ObjSet* set = (ObjSet*)object;
+            markTable(&set->items);
+            break;
+        }
+        case OBJ_SHAPE: {
+            // Transitions are deliberately not marked, see removeDeadShapes
+            ObjShape* shape = (ObjShape*)object;
+            markObject((Obj*)shape->parent);
+            markObject((Obj*)shape->key);
+            break;
+        }
+        case OBJ_LINES:
+            markObject(((ObjLines*)object)->source);
+            break;
+        case OBJ_BYTES:
+            markObject((Obj*)((ObjBytes*)object)->owner);
+            break;
+        case OBJ_BUILDER:
+        case OBJ_FILE:
+        case OBJ_MAPPED:
         case OBJ_NATIVE:
+        case OBJ_NUMBERS:
+        case OBJ_REGEX:
         case OBJ_STRING:
             break;
     }
@@ -110,25 +153,63 @@ static void freeObject(Obj* object) {
     printf("%p free type %s\n", (void*)object, stringFromObjType(object->type));
 #endif
     switch (object->type) {
+        case OBJ_BUILDER: {
+            ObjBuilder* builder = (ObjBuilder*)object;
+            FREE_ARRAY(char, builder->chars, builder->capacity);
+            FREE(ObjBuilder, object);
+            break;
+        }
+        case OBJ_BYTES: {
+            ObjBytes* bytes = (ObjBytes*)object;
+            FREE_ARRAY(uint8_t, bytes->bytes, bytes->capacity);
+            FREE(ObjBytes, object);
+            break;
+        }
         case OBJ_CLOSURE: {
             ObjClosure* closure = (ObjClosure*)object;
             FREE_ARRAY(ObjUpvalue*, closure->upvalues, closure->upvalueCount);
             FREE(ObjClosure, object);
             break;
         }
+        case OBJ_FILE:
+            closeFile((ObjFile*)object);
+            FREE(ObjFile, object);
+            break;
         case OBJ_FUNCTION: {
             ObjFunction* function = (ObjFunction*)object;
             freeChunk(&function->chunk);
             FREE(ObjFunction, object);
             break;
         }
+        case OBJ_LINES:
+            FREE(ObjLines, object);
+            break;
+        case OBJ_MAPPED: {
+            ObjMapped* mapped = (ObjMapped*)object;
+            unmapFile(mapped->chars, mapped->length);
+            FREE(ObjMapped, object);
+            break;
+        }
         case OBJ_NATIVE:
             FREE(ObjNative, object);
             break;
+        case OBJ_NUMBERS: {
+            ObjNumbers* numbers = (ObjNumbers*)object;
+            FREE_ARRAY(double, numbers->items, numbers->capacity);
+            FREE(ObjNumbers, object);
+            break;
+        }
+        case OBJ_REGEX:
+            freeRegex(((ObjRegex*)object)->regex);
+            FREE(ObjRegex, object);
+            break;
         case OBJ_STRING: {
             ObjString* string = (ObjString*)object;
-            FREE_ARRAY(char, string->chars, string->length + 1);
-            FREE(ObjString, object);
+            if (string->offsets != NULL) {
+                FREE_ARRAY(int, string->offsets,
+                           (string->charCount - 1) / STRING_INDEX_STRIDE + 1);
+            }
+            reallocate(object, sizeof(ObjString) + string->length + 1, 0);
             break;
         }
         case OBJ_UPVALUE: {
@@ -143,10 +224,26 @@ static void freeObject(Obj* object) {
         }
         case OBJ_MAP: {
             ObjMap* map = (ObjMap*)object;
+            FREE_ARRAY(Value, map->array, map->arrayCapacity);
             freeTable(&map->items);
             FREE(ObjMap, object);
             break;
         }
+        case OBJ_ROPE:
+            FREE(ObjRope, object);
+            break;
+        case OBJ_SET: {
+            ObjSet* set = (ObjSet*)object;
+            freeTable(&set->items);
+            FREE(ObjSet, object);
+            break;
+        }
+        case OBJ_SHAPE: {
+            ObjShape* shape = (ObjShape*)object;
+            freeTable(&shape->transitions);
+            FREE(ObjShape, object);
+            break;
+        }
     }
 }
 
@@ -168,6 +265,14 @@ static void markRoots() {
 
     // Globals
     markTable(&vm.globals);
+
+    // Root of the shape tree
+    markObject((Obj*)vm.emptyShape);
+
+    // Single character strings
+    for (int i = 0; i < UINT8_COUNT; i++) {
+        markObject((Obj*)vm.characters[i]);
+    }
     
     // Compiler
     markCompilerRoots();
@@ -180,6 +285,23 @@ static void traceReferences() {
     }
 }
 
+static void removeDeadShapes(ObjShape* shape) {
+    // Every live shape keeps its ancestors alive, so walking down from the
+    // root reaches all of them. Drop transitions to shapes about to be swept.
+    Table* transitions = &shape->transitions;
+    for (int i = 0; i < transitions->entryCount; i++) {
+        Entry* entry = &transitions->entries[i];
+        if (entry->empty) continue;
+
+        ObjShape* child = AS_SHAPE(entry->value);
+        if (child->obj.isMarked) {
+            removeDeadShapes(child);
+        } else {
+            tableDelete(transitions, entry->key);
+        }
+    }
+}
+
 static void sweep() {
     Obj* previous = NULL;
     Obj* object = vm.objects;
@@ -213,9 +335,12 @@ void collectGarbage() {
     markRoots();
     traceReferences();
     tableRemoveWhite(&vm.strings);
+    if (vm.emptyShape != NULL) removeDeadShapes(vm.emptyShape);
     sweep();
 
     vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
+    vm.nextFileGC = vm.openFiles * GC_HEAP_GROW_FACTOR;
+    if (vm.nextFileGC < FILE_GC_MIN) vm.nextFileGC = FILE_GC_MIN;
 
 #ifdef DEBUG_LOG_GC
     printf("-- gc end\n");
@@ -23,6 +23,10 @@ void* reallocate(void* previous, size_t oldSize, size_t newSize);
 void markObject(Obj* object);
 void markValue(Value value);
 void collectGarbage();
+
+// Open files that trigger a collection at the least, well under the usual
+// limit of 1024 descriptors
+#define FILE_GC_MIN 256
 void freeObjects();
 
 #endif
@@ -1,18 +1,34 @@
+#define _POSIX_C_SOURCE 200809L // For clock_gettime
+
+#include <errno.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include "compress.h"
+#include "csv.h"
+#include "file.h"
+#include "hash.h"
+#include "json.h"
 #include "memory.h"
 #include "native.h"
+#include "number.h"
+#include "output.h"
+#include "search.h"
 
 /*
 Standard Library:
-append, assert, clock, delete, has, input, items, keys, len, num, print, values, write
+add, append, appendNumber, assert, bench, build, builder, bytes, clock, close, compress,
+compressFile, count, cpuTime, crc32, decompress, decompressFile, delete, difference, find,
+findAll, flush, has, input, intersection, items, join, jsonParse, jsonStringify, keys, len,
+lines, match, md5, next, now, num, open, openMapped, pack, print, readAll, readCsv,
+readCsvColumns, readFile, regex, replace, search, set, sha256, slice, split, startsWith,
+str, sum, trim, union, unpack, values, write, writeFile, xxhash64
 
 Missing:
-bool, string, list, map, set, slice
+bool, list, map
 */
 
 #define VALIDATE_ARG_COUNT(funcName, numArgs) \
@@ -24,12 +40,93 @@ bool, string, list, map, set, slice
         } \
     } while (false)
 
+static bool validateStringArgs(const char* name, int count, Value* args, char errMsg[]) {
+    static const char* ordinals[] = {"first", "second", "third"};
+    for (int i = 0; i < count; i++) {
+        if (!IS_STRING(args[i])) {
+            sprintf(errMsg, "%s expected the %s argument to be a string.", name, ordinals[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Reads the bytes of a string, mapped file or bytes for the natives over raw
+// data
+static bool validateDataArg(const char* name, Value value, const char** chars, size_t* length,
+                            char errMsg[]) {
+    if (IS_STRING(value)) {
+        ObjString* string = AS_STRING(value);
+        *chars = string->chars;
+        *length = string->length;
+        return false;
+    }
+    if (IS_MAPPED(value)) {
+        *chars = AS_MAPPED(value)->chars;
+        *length = AS_MAPPED(value)->length;
+        return false;
+    }
+    if (IS_BYTES(value)) {
+        *chars = (const char*)bytesData(AS_BYTES(value));
+        *length = AS_BYTES(value)->length;
+        return false;
+    }
+    sprintf(errMsg, "%s expected a string, mapped file or bytes.", name);
+    return true;
+}
+
+static bool addNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Add an item to a set if it isn't already there
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(add, 2);
+    if (!IS_SET(*args)) {
+        sprintf(errMsg, "add expected the first argument to be a set.");
+        return true;
+    }
+    if (!isHashable(*(args + 1))) {
+        sprintf(errMsg, "add expected item to be hashable.");
+        return true;
+    }
+    tableSet(&AS_SET(*args)->items, *(args + 1), NIL_VAL);
+    return false;
+}
+
 static bool appendNative(int argCount, Value* args, Value* result, char errMsg[]) {
-    // Append a value to the end of a list increasing the list's length by 1
+    // Append a value to the end of a list increasing the list's length by 1,
+    // a string to the end of a builder, or raw data to the end of bytes
     VALIDATE_ARG_COUNT(append, 2);
+    if (IS_BYTES(*args)) {
+        *result = NIL_VAL;
+        ObjBytes* bytes = AS_BYTES(*args);
+        const char* chars;
+        size_t length;
+        if (validateDataArg("append", *(args + 1), &chars, &length, errMsg)) {
+            return true;
+        }
+        if (bytes->owner != NULL) {
+            sprintf(errMsg, "append can't grow a view of bytes.");
+            return true;
+        }
+        if (length > (size_t)(INT32_MAX - bytes->length)) {
+            sprintf(errMsg, "append would make bytes too long.");
+            return true;
+        }
+        appendToBytes(bytes, chars, length);
+        return false;
+    }
+    if (IS_BUILDER(*args)) {
+        *result = NIL_VAL;
+        if (!IS_STRING(*(args + 1))) {
+            sprintf(errMsg, "append expected a string for a builder.");
+            return true;
+        }
+        ObjString* string = AS_STRING(*(args + 1));
+        appendToBuilder(AS_BUILDER(*args), string->chars, string->length);
+        return false;
+    }
     if (!IS_LIST(*args)) {
         *result = NIL_VAL;
-        sprintf(errMsg, "append expected the first argument to be a list.");
+        sprintf(errMsg, "append expected the first argument to be a list, builder or bytes.");
         return true;
     }
     ObjList* list = AS_LIST(*args);
@@ -39,6 +136,24 @@ static bool appendNative(int argCount, Value* args, Value* result, char errMsg[]
     return false;
 }
 
+static bool appendNumberNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Append the text of a number to the end of a builder
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(appendNumber, 2);
+    if (!IS_BUILDER(*args)) {
+        sprintf(errMsg, "appendNumber expected the first argument to be a builder.");
+        return true;
+    }
+    if (!IS_NUMBER(*(args + 1))) {
+        sprintf(errMsg, "appendNumber expected the second argument to be a number.");
+        return true;
+    }
+    char buffer[NUMBER_BUFFER_SIZE];
+    int length = formatNumber(AS_NUMBER(*(args + 1)), buffer);
+    appendToBuilder(AS_BUILDER(*args), buffer, length);
+    return false;
+}
+
 static bool assertNative(int argCount, Value* args, Value* result, char errMsg[]) {
     // Throw a runtime error if the argument does not evaluate to true
     VALIDATE_ARG_COUNT(assert, 1);
@@ -51,13 +166,283 @@ static bool assertNative(int argCount, Value* args, Value* result, char errMsg[]
     return false;
 }
 
+// Nanoseconds on a clock, as a number, which is exact for over 100 days
+static double clockNanos(clockid_t clock) {
+    struct timespec time;
+    clock_gettime(clock, &time);
+    return (double)time.tv_sec * 1e9 + (double)time.tv_nsec;
+}
+
+static int compareTimes(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void storeTime(ObjMap* map, const char* name, double time) {
+    Value key = OBJ_VAL(copyString(name, (int)strlen(name)));
+    push(key);
+    storeToMap(map, key, NUMBER_VAL(time));
+    pop();
+}
+
+static bool benchNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Time calls of a function with no parameters on the monotonic clock after
+    // a tenth as many untimed warmup calls. Returns a map of the fastest,
+    // median, 99th percentile and mean call in nanoseconds.
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(bench, 2);
+    Value function = *args;
+    if (!IS_CLOSURE(function) && !IS_NATIVE(function)) {
+        sprintf(errMsg, "bench expected the first argument to be a function.");
+        return true;
+    }
+    double count = IS_NUMBER(*(args + 1)) ? AS_NUMBER(*(args + 1)) : 0;
+    if (!(count >= 1 && count <= 100000000) || count != (int)count) {
+        sprintf(errMsg, "bench expected the iterations to be a positive integer.");
+        return true;
+    }
+    int iterations = (int)count;
+
+    Value ignored;
+    for (int i = 0; i < iterations / 10 + 1; i++) {
+        push(function);
+        if (!callFromNative(0, &ignored)) {
+            errMsg[0] = '\0';
+            return true;
+        }
+    }
+    double* times = ALLOCATE(double, iterations);
+    double total = 0;
+    for (int i = 0; i < iterations; i++) {
+        push(function);
+        double start = clockNanos(CLOCK_MONOTONIC);
+        bool ok = callFromNative(0, &ignored);
+        times[i] = clockNanos(CLOCK_MONOTONIC) - start;
+        if (!ok) {
+            FREE_ARRAY(double, times, iterations);
+            errMsg[0] = '\0';
+            return true;
+        }
+        total += times[i];
+    }
+
+    qsort(times, iterations, sizeof(double), compareTimes);
+    double median = iterations % 2 == 1 ? times[iterations / 2] :
+        (times[iterations / 2 - 1] + times[iterations / 2]) / 2;
+    // Nearest rank: the smallest time at least 99% of calls were as fast as
+    int p99 = (int)ceil(iterations * 0.99) - 1;
+
+    ObjMap* map = newMap();
+    push(OBJ_VAL(map));
+    storeTime(map, "min", times[0]);
+    storeTime(map, "median", median);
+    storeTime(map, "p99", times[p99]);
+    storeTime(map, "mean", total / iterations);
+    FREE_ARRAY(double, times, iterations);
+    *result = pop();
+    return false;
+}
+
+static bool buildNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a string of everything appended to a builder so far
+    VALIDATE_ARG_COUNT(build, 1);
+    if (!IS_BUILDER(*args)) {
+        *result = NIL_VAL;
+        sprintf(errMsg, "build expected the first argument to be a builder.");
+        return true;
+    }
+    ObjBuilder* builder = AS_BUILDER(*args);
+    ObjString* string = newString(builder->length);
+    memcpy(string->chars, builder->chars, builder->length);
+    *result = OBJ_VAL(string);
+    return false;
+}
+
+static bool builderNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a new empty string builder
+    VALIDATE_ARG_COUNT(builder, 0);
+    *result = OBJ_VAL(newBuilder());
+    return false;
+}
+
+static bool bytesNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return new zeroed bytes of a given length, or a copy of a string, mapped
+    // file or bytes
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(bytes, 1);
+    if (IS_NUMBER(*args)) {
+        double length = AS_NUMBER(*args);
+        if (!(length >= 0 && length <= INT32_MAX) || length != (int)length) {
+            sprintf(errMsg, "bytes expected a length from 0 to %d.", INT32_MAX);
+            return true;
+        }
+        *result = OBJ_VAL(newBytes((int)length));
+        return false;
+    }
+    const char* chars;
+    size_t length;
+    if (validateDataArg("bytes", *args, &chars, &length, errMsg)) {
+        sprintf(errMsg, "bytes expected a length, string, mapped file or bytes.");
+        return true;
+    }
+    if (length > INT32_MAX) {
+        sprintf(errMsg, "bytes can't hold more than %d bytes.", INT32_MAX);
+        return true;
+    }
+    uint8_t* data = NULL;
+    if (length > 0) {
+        data = ALLOCATE(uint8_t, length);
+        memcpy(data, chars, length);
+    }
+    *result = OBJ_VAL(takeBytes(data, (int)length, (int)length));
+    return false;
+}
+
 static bool clockNative(int argCount, Value* args, Value* result, char errMsg[]) {
-    // Return a double representing the number of seconds the process has been alive
+    // Return the CPU time the process has used in seconds, at coarse
+    // resolution. now() and cpuTime() are better for timing.
     VALIDATE_ARG_COUNT(clock, 0);
     *result = NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
     return false;
 }
 
+static bool closeNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Close a file. Closing it again does nothing.
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(close, 1);
+    if (!IS_FILE(*args)) {
+        sprintf(errMsg, "close expected the argument to be a file.");
+        return true;
+    }
+    closeFile(AS_FILE(*args));
+    return false;
+}
+
+// Reads the name of a compression format
+static bool validateFormatArg(const char* name, Value value, CompressFormat* format,
+                              char errMsg[]) {
+    if (IS_STRING(value)) {
+        const char* chars = AS_CSTRING(value);
+        if (strcmp(chars, "lz4") == 0) {
+            *format = COMPRESS_LZ4;
+            return false;
+        }
+        if (strcmp(chars, "deflate") == 0) {
+            *format = COMPRESS_DEFLATE;
+            return false;
+        }
+        if (strcmp(chars, "gzip") == 0) {
+            *format = COMPRESS_GZIP;
+            return false;
+        }
+    }
+    sprintf(errMsg, "%s expected the format to be 'lz4', 'deflate' or 'gzip'.", name);
+    return true;
+}
+
+static bool compressNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a string, mapped file or bytes compressed in the given format,
+    // as bytes if given bytes and a string otherwise
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(compress, 2);
+    const char* chars;
+    size_t length;
+    CompressFormat format;
+    if (validateDataArg("compress", *args, &chars, &length, errMsg) ||
+        validateFormatArg("compress", *(args + 1), &format, errMsg)) {
+        return true;
+    }
+    return !compressBytes(format, chars, length, IS_BYTES(*args), result, errMsg);
+}
+
+static bool compressFileNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Compress one file into another a window at a time
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(compressFile, 3);
+    CompressFormat format;
+    if (validateStringArgs("compressFile", 2, args, errMsg) ||
+        validateFormatArg("compressFile", *(args + 2), &format, errMsg)) {
+        return true;
+    }
+    return !compressFile(format, AS_CSTRING(*args), AS_CSTRING(*(args + 1)), errMsg);
+}
+
+static bool countNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return how many non-overlapping times a substring occurs in a string
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(count, 2);
+    if (validateStringArgs("count", 2, args, errMsg)) {
+        return true;
+    }
+    ObjString* string = AS_STRING(*args);
+    ObjString* substring = AS_STRING(*(args + 1));
+    if (substring->length == 0) {
+        sprintf(errMsg, "count expected a non-empty substring.");
+        return true;
+    }
+    *result = NUMBER_VAL(countBytes(string->chars, string->length,
+                                    substring->chars, substring->length));
+    return false;
+}
+
+static bool cpuTimeNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the CPU time the process has used in nanoseconds
+    VALIDATE_ARG_COUNT(cpuTime, 0);
+    *result = NUMBER_VAL(clockNanos(CLOCK_PROCESS_CPUTIME_ID));
+    return false;
+}
+
+static Value hexValue(const uint8_t* bytes, int count) {
+    static const char digits[] = "0123456789abcdef";
+    char hex[64];
+    for (int i = 0; i < count; i++) {
+        hex[i * 2] = digits[bytes[i] >> 4];
+        hex[i * 2 + 1] = digits[bytes[i] & 0xF];
+    }
+    return OBJ_VAL(makeString(hex, count * 2));
+}
+
+static bool crc32Native(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the CRC-32 of a string, mapped file or bytes, as zlib computes it
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(crc32, 1);
+    const char* chars;
+    size_t length;
+    if (validateDataArg("crc32", *args, &chars, &length, errMsg)) {
+        return true;
+    }
+    *result = NUMBER_VAL(computeCrc32(chars, length));
+    return false;
+}
+
+static bool decompressNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the contents of a string, mapped file or bytes compressed in the
+    // given format, as bytes if given bytes and a string otherwise
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(decompress, 2);
+    const char* chars;
+    size_t length;
+    CompressFormat format;
+    if (validateDataArg("decompress", *args, &chars, &length, errMsg) ||
+        validateFormatArg("decompress", *(args + 1), &format, errMsg)) {
+        return true;
+    }
+    return !decompressBytes(format, chars, length, IS_BYTES(*args), result, errMsg);
+}
+
+static bool decompressFileNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Decompress one file into another a window at a time
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(decompressFile, 3);
+    CompressFormat format;
+    if (validateStringArgs("decompressFile", 2, args, errMsg) ||
+        validateFormatArg("decompressFile", *(args + 2), &format, errMsg)) {
+        return true;
+    }
+    return !decompressFile(format, AS_CSTRING(*args), AS_CSTRING(*(args + 1)), errMsg);
+}
+
 static bool deleteNative(int argCount, Value* args, Value* result, char errMsg[]) {
     // Delete an item from a list or map
     *result = NIL_VAL;
@@ -84,18 +469,130 @@ static bool deleteNative(int argCount, Value* args, Value* result, char errMsg[]
         }
         ObjMap* map = AS_MAP(*args);
         Value key = *(args + 1);
-        tableDelete(&map->items, key);
+        deleteFromMap(map, key);
+        return false;
+    } else if (IS_SET(*args)) {
+        if (!isHashable(*(args + 1))) {
+            sprintf(errMsg, "delete expected a hashable item for a set.");
+            return true;
+        }
+        tableDelete(&AS_SET(*args)->items, *(args + 1));
         return false;
     } else {
-        sprintf(errMsg, "delete expected the first argument to be a list or map.");
+        sprintf(errMsg, "delete expected the first argument to be a list, map, or set.");
         return true;
     }
     // Shouldn't reach here
     return false;
 }
 
+static bool validateSetArgs(const char* name, Value* args, char errMsg[]) {
+    if (!IS_SET(*args) || !IS_SET(*(args + 1))) {
+        sprintf(errMsg, "%s expected both arguments to be sets.", name);
+        return true;
+    }
+    return false;
+}
+
+static bool differenceNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a new set of the items in the first set but not the second
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(difference, 2);
+    if (validateSetArgs("difference", args, errMsg)) {
+        return true;
+    }
+    ObjSet* a = AS_SET(*args);
+    ObjSet* b = AS_SET(*(args + 1));
+    ObjSet* set = newSet();
+    push(OBJ_VAL(set));
+    for (int i = 0; i < a->items.entryCount; i++) {
+        Entry* entry = &a->items.entries[i];
+        if (!entry->empty && !isInSet(b, entry->key)) {
+            tableSet(&set->items, entry->key, NIL_VAL);
+        }
+    }
+    *result = pop();
+    return false;
+}
+
+static bool validateRegexArgs(const char* name, Value* args, char errMsg[]) {
+    if (!IS_REGEX(*args)) {
+        sprintf(errMsg, "%s expected the first argument to be a regex.", name);
+        return true;
+    }
+    if (!IS_STRING(*(args + 1))) {
+        sprintf(errMsg, "%s expected the second argument to be a string.", name);
+        return true;
+    }
+    return false;
+}
+
+// Where to search from after a match. An empty match steps over a character
+// so the search moves on; past the end of the string means stop.
+static int afterMatch(ObjString* string, int start, int end) {
+    if (end > start) return end;
+    if (end >= string->length) return string->length + 1;
+    end++;
+    while (end < string->length && (string->chars[end] & 0xC0) == 0x80) end++;
+    return end;
+}
+
+static bool findNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the index of the first occurrence of a substring in a string or -1
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(find, 2);
+    if (validateStringArgs("find", 2, args, errMsg)) {
+        return true;
+    }
+    ObjString* string = AS_STRING(*args);
+    ObjString* substring = AS_STRING(*(args + 1));
+    int offset = findBytes(string->chars, string->length, 0,
+                           substring->chars, substring->length);
+    *result = NUMBER_VAL(offset < 0 ? -1 : stringCharIndex(string, offset));
+    return false;
+}
+
+static bool findAllNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a list of every match of a regex in a string, leaving out empty
+    // matches right after another match
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(findAll, 2);
+    if (validateRegexArgs("findAll", args, errMsg)) {
+        return true;
+    }
+    Regex* regex = AS_REGEX(*args)->regex;
+    ObjString* string = AS_STRING(*(args + 1));
+    ObjList* list = newList();
+    push(OBJ_VAL(list));
+
+    int capCount = 2 * (regexGroupCount(regex) + 1);
+    int* captures = ALLOCATE(int, capCount);
+    int previousEnd = -1;
+    int start = 0;
+    while (searchRegex(regex, string->chars, string->length, start, false, captures, false)) {
+        start = afterMatch(string, captures[0], captures[1]);
+        if (captures[0] == captures[1] && captures[0] == previousEnd) continue;
+        Value match = OBJ_VAL(makeString(string->chars + captures[0], captures[1] - captures[0]));
+        push(match);
+        appendToList(list, match);
+        pop();
+        previousEnd = captures[1];
+    }
+    FREE_ARRAY(int, captures, capCount);
+    *result = pop();
+    return false;
+}
+
+static bool flushNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Write out everything printed so far
+    VALIDATE_ARG_COUNT(flush, 0);
+    flushOutput();
+    *result = NIL_VAL;
+    return false;
+}
+
 static bool hasNative(int argCount, Value* args, Value* result, char errMsg[]) {
-    // Determine if a list or map has a particular item
+    // Determine if a list, map or set has a particular item
     *result = BOOL_VAL(false);
     VALIDATE_ARG_COUNT(has, 2);
     if (IS_LIST(*args)) {
@@ -113,17 +610,18 @@ static bool hasNative(int argCount, Value* args, Value* result, char errMsg[]) {
             sprintf(errMsg, "has expected item to be hashable.");
             return true;
         }
-        ObjMap* map = AS_MAP(*args);
-        Value item = *(args + 1);
-        for (int i = 0; i < map->items.capacity; i++) {
-            if (valuesEqual(item, map->items.entries[i].key)) {
-                *result = BOOL_VAL(true);
-                break;
-            }
+        Value value;
+        *result = BOOL_VAL(indexFromMap(AS_MAP(*args), *(args + 1), &value));
+        return false;
+    } else if (IS_SET(*args)) {
+        if (!isHashable(*(args + 1))) {
+            sprintf(errMsg, "has expected item to be hashable.");
+            return true;
         }
+        *result = BOOL_VAL(isInSet(AS_SET(*args), *(args + 1)));
         return false;
     } else {
-        sprintf(errMsg, "has expected the first argument to be a list or map.");
+        sprintf(errMsg, "has expected the first argument to be a list, map, or set.");
         return true;
     }
     // Shouldn't reach here
@@ -131,26 +629,34 @@ static bool hasNative(int argCount, Value* args, Value* result, char errMsg[]) {
 }
 
 static bool inputNative(int argCount, Value* args, Value* result, char errMsg[]) {
-    // Return a string representing a line read from STDIN
+    // Return a string representing a line read from STDIN or nil at the end
     VALIDATE_ARG_COUNT(input, 0);
-    int count = 0;
-    int capacity = GROW_CAPACITY(0);
-    char* input = NULL;
-    input = GROW_ARRAY(input, char, 0, capacity);
+    // Show any prompt before waiting
+    flushOutput();
+    int length;
+    const char* line = readLine(&vm.input, &length);
+    *result = line == NULL ? NIL_VAL : OBJ_VAL(makeString(line, length));
+    return false;
+}
 
-    // Read in characters until we read 'enter'
-    do {
-        if (capacity < count + 1) {
-            int oldCapacity = capacity;
-            capacity = GROW_CAPACITY(oldCapacity);
-            input = GROW_ARRAY(input, char, oldCapacity, capacity);
+static bool intersectionNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a new set of the items in both sets
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(intersection, 2);
+    if (validateSetArgs("intersection", args, errMsg)) {
+        return true;
+    }
+    ObjSet* a = AS_SET(*args);
+    ObjSet* b = AS_SET(*(args + 1));
+    ObjSet* set = newSet();
+    push(OBJ_VAL(set));
+    for (int i = 0; i < a->items.entryCount; i++) {
+        Entry* entry = &a->items.entries[i];
+        if (!entry->empty && isInSet(b, entry->key)) {
+            tableSet(&set->items, entry->key, NIL_VAL);
         }
-        // Convoluted (void) and +1 to make compiler ignore return value
-        (void)(scanf("%c", &input[count++])+1);
-    } while (input[count - 1] != 0x0A);
-
-    *result = OBJ_VAL(copyString(input, count - 1));
-    FREE_ARRAY(char, input, count);
+    }
+    *result = pop();
     return false;
 }
 
@@ -166,15 +672,14 @@ static bool itemsNative(int argCount, Value* args, Value* result, char errMsg[])
     Value itemsValue = OBJ_VAL(itemsList);
     push(itemsValue);
 
-    for (int i = 0; i < map->items.capacity; i++) {
-        if (map->items.entries[i].empty) {
-            continue;
-        }
+    int cursor = 0;
+    Value key, value;
+    while (nextInMap(map, &cursor, &key, &value)) {
         ObjList* kvPairList = newList();
         Value kvPairValue = OBJ_VAL(kvPairList);
         push(kvPairValue);
-        appendToList(kvPairList, map->items.entries[i].key);
-        appendToList(kvPairList, map->items.entries[i].value);
+        appendToList(kvPairList, key);
+        appendToList(kvPairList, value);
         appendToList(itemsList, kvPairValue);
         pop(kvPairValue);
     }
@@ -184,6 +689,65 @@ static bool itemsNative(int argCount, Value* args, Value* result, char errMsg[])
     return false;
 }
 
+static bool joinNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the strings in a list joined together with a separator between each
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(join, 2);
+    if (!IS_LIST(*args)) {
+        sprintf(errMsg, "join expected the first argument to be a list.");
+        return true;
+    }
+    if (!IS_STRING(*(args + 1))) {
+        sprintf(errMsg, "join expected the separator to be a string.");
+        return true;
+    }
+    ObjList* list = AS_LIST(*args);
+    ObjString* separator = AS_STRING(*(args + 1));
+
+    // Size the result up front so it's copied into exactly once
+    int length = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (!IS_STRING(list->items[i])) {
+            sprintf(errMsg, "join expected every item to be a string.");
+            return true;
+        }
+        length += stringLength(list->items[i]);
+    }
+    if (list->count > 1) {
+        length += separator->length * (list->count - 1);
+    }
+
+    ObjString* string = newString(length);
+    push(OBJ_VAL(string));
+    char* dest = string->chars;
+    for (int i = 0; i < list->count; i++) {
+        if (i > 0) {
+            memcpy(dest, separator->chars, separator->length);
+            dest += separator->length;
+        }
+        // Rope items are copied leaf by leaf rather than flattened first
+        writeString(list->items[i], dest);
+        dest += stringLength(list->items[i]);
+    }
+    *result = pop();
+    return false;
+}
+
+static bool jsonParseNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the value a string of JSON describes
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(jsonParse, 1);
+    if (validateStringArgs("jsonParse", 1, args, errMsg)) return true;
+    return !parseJson(AS_STRING(*args), result, errMsg);
+}
+
+static bool jsonStringifyNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a value of nested lists, maps, strings, numbers, bools and nil as JSON
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(jsonStringify, 1);
+    return !stringifyJson(*args, result, errMsg);
+}
+
 static bool keysNative(int argCount, Value* args, Value* result, char errMsg[]) {
     // Return a list of the keys in a map
     VALIDATE_ARG_COUNT(keys, 1);
@@ -196,11 +760,10 @@ static bool keysNative(int argCount, Value* args, Value* result, char errMsg[])
     Value keysValue = OBJ_VAL(keysList);
     push(keysValue);
 
-    for (int i = 0; i < map->items.capacity; i++) {
-        if (map->items.entries[i].empty) {
-            continue;
-        }
-        appendToList(keysList, map->items.entries[i].key);
+    int cursor = 0;
+    Value key, value;
+    while (nextInMap(map, &cursor, &key, &value)) {
+        appendToList(keysList, key);
     }
 
     pop();
@@ -213,8 +776,7 @@ static bool lenNative(int argCount, Value* args, Value* result, char errMsg[]) {
     VALIDATE_ARG_COUNT(len, 1);
     Value value = *args;
     if (IS_STRING(value)) {
-        ObjString* string = AS_STRING(value);
-        *result = NUMBER_VAL(string->length);
+        *result = NUMBER_VAL(stringCharLength(value));
         return false;
     } else if (IS_LIST(value)) {
         ObjList* list = AS_LIST(value);
@@ -222,43 +784,143 @@ static bool lenNative(int argCount, Value* args, Value* result, char errMsg[]) {
         return false;
     } else if (IS_MAP(value)) {
         ObjMap* map = AS_MAP(value);
-        int len = 0;
-        for (int i = 0; i < map->items.capacity; i++) {
-            if (!map->items.entries[i].empty) {
-                len++;
-            }
-        }
-        *result = NUMBER_VAL(len);
+        *result = NUMBER_VAL(countMap(map));
+        return false;
+    } else if (IS_SET(value)) {
+        *result = NUMBER_VAL(AS_SET(value)->items.count);
+        return false;
+    } else if (IS_BUILDER(value)) {
+        *result = NUMBER_VAL(AS_BUILDER(value)->length);
+        return false;
+    } else if (IS_MAPPED(value)) {
+        *result = NUMBER_VAL((double)AS_MAPPED(value)->length);
+        return false;
+    } else if (IS_NUMBERS(value)) {
+        *result = NUMBER_VAL(AS_NUMBERS(value)->count);
+        return false;
+    } else if (IS_BYTES(value)) {
+        *result = NUMBER_VAL(AS_BYTES(value)->length);
         return false;
     } else {
         *result = NIL_VAL;
-        sprintf(errMsg, "len expected a list, string, or map.");
+        sprintf(errMsg, "len expected a list, string, map, set, builder, mapped file, number "
+                        "array, or bytes.");
         return true;
     }
 }
 
-// TODO handle all edge cases here
-static bool numNative(int argCount, Value* args, Value* result, char errMsg[]) {
-    // Attempt to convert a value into a number
-    VALIDATE_ARG_COUNT(num, 1);
-    Value value = *args;
-    if (IS_BOOL(value)) {
-        if (isFalsey(value)) {
-            *result = NUMBER_VAL(0);
-        } else {
-            *result = NUMBER_VAL(1);
-        }
+static bool linesNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return an iterator over the lines of a file or STDIN, read as they're
+    // asked for
+    *result = NIL_VAL;
+    if (argCount == 0) {
+        *result = OBJ_VAL(newLines(&vm.input, NULL));
         return false;
-    } if (IS_NUMBER(value)) {
-        *result = value;
+    }
+    VALIDATE_ARG_COUNT(lines, 1);
+    if (!IS_FILE(*args)) {
+        sprintf(errMsg, "lines expected the argument to be a file.");
+        return true;
+    }
+    ObjFile* file = AS_FILE(*args);
+    *result = OBJ_VAL(newLines(&file->reader, (Obj*)file));
+    return false;
+}
+
+// Returns a list of a regex's match in a string followed by each group, nil
+// for groups that didn't take part, or nil if there's no match
+static Value matchGroups(ObjRegex* regex, ObjString* string, bool anchored) {
+    int groupCount = regexGroupCount(regex->regex);
+    int capCount = 2 * (groupCount + 1);
+    int* captures = ALLOCATE(int, capCount);
+    Value groups = NIL_VAL;
+    if (searchRegex(regex->regex, string->chars, string->length, 0, anchored, captures, true)) {
+        ObjList* list = newList();
+        push(OBJ_VAL(list));
+        reserveList(list, groupCount + 1);
+        for (int i = 0; i <= groupCount; i++) {
+            int start = captures[i * 2];
+            int end = captures[i * 2 + 1];
+            appendToList(list, start < 0 ? NIL_VAL :
+                         OBJ_VAL(makeString(string->chars + start, end - start)));
+        }
+        groups = pop();
+    }
+    FREE_ARRAY(int, captures, capCount);
+    return groups;
+}
+
+static bool matchNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the match of a regex at the start of a string and its groups, or nil
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(match, 2);
+    if (validateRegexArgs("match", args, errMsg)) {
+        return true;
+    }
+    *result = matchGroups(AS_REGEX(*args), AS_STRING(*(args + 1)), true);
+    return false;
+}
+
+static bool md5Native(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the MD5 digest of a string, mapped file or bytes in hex
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(md5, 1);
+    const char* chars;
+    size_t length;
+    if (validateDataArg("md5", *args, &chars, &length, errMsg)) {
+        return true;
+    }
+    uint8_t digest[16];
+    computeMd5(chars, length, digest);
+    *result = hexValue(digest, 16);
+    return false;
+}
+
+static bool nextNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the next item of an iterator or nil once it is exhausted
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(next, 1);
+    if (!IS_LINES(*args)) {
+        sprintf(errMsg, "next expected an iterator.");
+        return true;
+    }
+    int length;
+    const char* line = readLine(AS_LINES(*args)->reader, &length);
+    if (line != NULL) {
+        *result = OBJ_VAL(makeString(line, length));
+    }
+    return false;
+}
+
+static bool nowNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return nanoseconds on a clock that only moves forward, for timing.
+    // Counts from an arbitrary point, so only differences mean anything.
+    VALIDATE_ARG_COUNT(now, 0);
+    *result = NUMBER_VAL(clockNanos(CLOCK_MONOTONIC));
+    return false;
+}
+
+// TODO handle all edge cases here
+static bool numNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Attempt to convert a value into a number
+    VALIDATE_ARG_COUNT(num, 1);
+    Value value = *args;
+    if (IS_BOOL(value)) {
+        if (isFalsey(value)) {
+            *result = NUMBER_VAL(0);
+        } else {
+            *result = NUMBER_VAL(1);
+        }
+        return false;
+    } if (IS_NUMBER(value)) {
+        *result = value;
         return false;
     } if (IS_STRING(value)) {
-        char* err;
-        char* numString = AS_CSTRING(value);
-        double number = strtod(numString, &err);
-        if (*err != 0) {
+        ObjString* string = AS_STRING(value);
+        double number;
+        if (!parseNumber(string->chars, string->length, &number)) {
             *result = NIL_VAL;
-            sprintf(errMsg, "Cannot convert '%s' to a number.", numString);
+            snprintf(errMsg, NATIVE_ERROR_MAX, "Cannot convert '%s' to a number.", string->chars);
             return true;
         }
         *result = NUMBER_VAL(number);
@@ -270,23 +932,657 @@ static bool numNative(int argCount, Value* args, Value* result, char errMsg[]) {
     return true;
 }
 
+static bool openNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Open a file for reading
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(open, 1);
+    if (validateStringArgs("open", 1, args, errMsg)) {
+        return true;
+    }
+    const char* path = AS_CSTRING(*args);
+    // Files nothing refers to any more still hold their descriptors until
+    // collected
+    if (vm.openFiles >= vm.nextFileGC) collectGarbage();
+    int fd = openDescriptor(path);
+    if (fd < 0 && (errno == EMFILE || errno == ENFILE)) {
+        collectGarbage();
+        fd = openDescriptor(path);
+    }
+    if (fd < 0) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "open could not open '%s'.", path);
+        return true;
+    }
+    *result = OBJ_VAL(newFile(fd));
+    return false;
+}
+
+static bool openMappedNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a read-only view of a file's bytes that reads it in place
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(openMapped, 1);
+    if (validateStringArgs("openMapped", 1, args, errMsg)) {
+        return true;
+    }
+    const char* path = AS_CSTRING(*args);
+    char* chars;
+    size_t length;
+    if (!mapFile(path, &chars, &length)) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "openMapped could not map '%s'.", path);
+        return true;
+    }
+    *result = OBJ_VAL(newMapped(chars, length));
+    return false;
+}
+
+// Binary layouts pack and unpack convert numbers to and from, all little-endian
+typedef struct {
+    const char* name;
+    int size;
+    bool isSigned;
+    bool isFloat;
+} PackType;
+
+static const PackType packTypes[] = {
+    {"i8", 1, true, false}, {"u8", 1, false, false},
+    {"i16", 2, true, false}, {"u16", 2, false, false},
+    {"i32", 4, true, false}, {"u32", 4, false, false},
+    {"i64", 8, true, false}, {"u64", 8, false, false},
+    {"f32", 4, true, true}, {"f64", 8, true, true},
+};
+
+// Reads the bytes, offset and type arguments shared by pack and unpack
+static bool validatePackArgs(const char* name, Value* args, const PackType** type,
+                             char errMsg[]) {
+    if (!IS_BYTES(*args)) {
+        sprintf(errMsg, "%s expected the first argument to be bytes.", name);
+        return true;
+    }
+    double offset = IS_NUMBER(*(args + 1)) ? AS_NUMBER(*(args + 1)) : -1;
+    if (!(offset >= 0 && offset <= INT32_MAX) || offset != (int)offset) {
+        sprintf(errMsg, "%s expected the offset to be a non-negative integer.", name);
+        return true;
+    }
+    if (IS_STRING(*(args + 2))) {
+        for (size_t i = 0; i < sizeof(packTypes) / sizeof(packTypes[0]); i++) {
+            if (strcmp(AS_CSTRING(*(args + 2)), packTypes[i].name) == 0) {
+                *type = &packTypes[i];
+                return false;
+            }
+        }
+    }
+    sprintf(errMsg, "%s expected the type to be i8, u8, i16, u16, i32, u32, i64, u64, f32 "
+                    "or f64.", name);
+    return true;
+}
+
+static bool packNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Write a number into bytes at an offset in a binary layout such as 'u32'
+    // or 'f64', growing them if it runs past the end. Returns the offset just
+    // after what was written.
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(pack, 4);
+    const PackType* type;
+    if (validatePackArgs("pack", args, &type, errMsg)) {
+        return true;
+    }
+    ObjBytes* bytes = AS_BYTES(*args);
+    int offset = (int)AS_NUMBER(*(args + 1));
+    if (offset > bytes->length) {
+        sprintf(errMsg, "pack offset out of range.");
+        return true;
+    }
+    if (!IS_NUMBER(*(args + 3))) {
+        sprintf(errMsg, "pack expected the value to be a number.");
+        return true;
+    }
+    double value = AS_NUMBER(*(args + 3));
+
+    uint64_t bits;
+    if (type->isFloat && type->size == 4) {
+        float single = (float)value;
+        uint32_t singleBits;
+        memcpy(&singleBits, &single, 4);
+        bits = singleBits;
+    } else if (type->isFloat) {
+        memcpy(&bits, &value, 8);
+    } else {
+        double limit = ldexp(1, type->size * 8 - (type->isSigned ? 1 : 0));
+        double lowest = type->isSigned ? -limit : 0;
+        if (!(value >= lowest && value < limit) || value != trunc(value)) {
+            sprintf(errMsg, "pack expected an integer that fits in %s.", type->name);
+            return true;
+        }
+        bits = value < 0 ? (uint64_t)(int64_t)value : (uint64_t)value;
+    }
+
+    if (offset + type->size > bytes->length) {
+        if (bytes->owner != NULL) {
+            sprintf(errMsg, "pack can't grow a view of bytes.");
+            return true;
+        }
+        if (offset > INT32_MAX - type->size) {
+            sprintf(errMsg, "pack would make bytes too long.");
+            return true;
+        }
+        resizeBytes(bytes, offset + type->size);
+    }
+    uint8_t* out = bytesData(bytes) + offset;
+    for (int i = 0; i < type->size; i++) out[i] = (uint8_t)(bits >> (i * 8));
+    *result = NUMBER_VAL(offset + type->size);
+    return false;
+}
+
 static bool printNative(int argCount, Value* args, Value* result, char errMsg[]) {
     VALIDATE_ARG_COUNT(print, 1);
     if (IS_STRING(*args)) {
-        printf("%s", AS_CSTRING(*args));
+        ObjString* string = AS_STRING(*args);
+        writeOutput(string->chars, string->length);
     } else {
         printValue(*args);
     }
-    printf("\n");
+    WRITE_LITERAL("\n");
+    *result = NIL_VAL;
+    return false;
+}
+
+static bool readAllNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return everything left in a file or on STDIN as one string
+    *result = NIL_VAL;
+    if (argCount == 0) {
+        flushOutput();
+        *result = OBJ_VAL(readRest(&vm.input));
+        return false;
+    }
+    VALIDATE_ARG_COUNT(readAll, 1);
+    if (!IS_FILE(*args)) {
+        sprintf(errMsg, "readAll expected the argument to be a file.");
+        return true;
+    }
+    *result = OBJ_VAL(readRest(&AS_FILE(*args)->reader));
+    return false;
+}
+
+static bool readCsvNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the rows of a CSV file as lists of strings
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(readCsv, 1);
+    if (validateStringArgs("readCsv", 1, args, errMsg)) {
+        return true;
+    }
+    return !readCsvRows(AS_CSTRING(*args), result, errMsg);
+}
+
+static bool readCsvColumnsNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a map from the names in the first row of a CSV file to their
+    // columns, which are number arrays where every cell is numeric
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(readCsvColumns, 1);
+    if (validateStringArgs("readCsvColumns", 1, args, errMsg)) {
+        return true;
+    }
+    return !readCsvColumns(AS_CSTRING(*args), result, errMsg);
+}
+
+static bool readFileNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the contents of a file as a string
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(readFile, 1);
+    if (validateStringArgs("readFile", 1, args, errMsg)) {
+        return true;
+    }
+    const char* path = AS_CSTRING(*args);
+    ObjString* contents;
+    if (!readWholeFile(path, &contents)) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "readFile could not read '%s'.", path);
+        return true;
+    }
+    *result = OBJ_VAL(contents);
+    return false;
+}
+
+static bool regexNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a compiled regular expression
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(regex, 1);
+    if (validateStringArgs("regex", 1, args, errMsg)) {
+        return true;
+    }
+    ObjString* pattern = AS_STRING(*args);
+    Regex* regex = compileRegex(pattern->chars, pattern->length, errMsg);
+    if (regex == NULL) {
+        return true;
+    }
+    *result = OBJ_VAL(newRegex(regex));
+    return false;
+}
+
+// Replaces every match of a regex, leaving out empty matches right after
+// another. $0 to $9 in the replacement stand for the match and its groups
+// and $$ for a $.
+static bool replaceRegex(Value* args, Value* result, char errMsg[]) {
+    ObjString* string = AS_STRING(*args);
+    Regex* regex = AS_REGEX(*(args + 1))->regex;
+    ObjString* replacement = AS_STRING(*(args + 2));
+    int groupCount = regexGroupCount(regex);
+    bool wantGroups = false;
+    for (int i = 0; i + 1 < replacement->length; i++) {
+        if (replacement->chars[i] != '$') continue;
+        char c = replacement->chars[++i];
+        if (c >= '0' && c <= '9') {
+            if (c - '0' > groupCount) {
+                sprintf(errMsg, "replace found a reference to a missing group.");
+                return true;
+            }
+            if (c > '0') wantGroups = true;
+        }
+    }
+
+    ObjBuilder* builder = newBuilder();
+    push(OBJ_VAL(builder));
+    int capCount = 2 * (groupCount + 1);
+    int* captures = ALLOCATE(int, capCount);
+    int copied = 0;
+    int previousEnd = -1;
+    int start = 0;
+    while (searchRegex(regex, string->chars, string->length, start, false, captures, wantGroups)) {
+        start = afterMatch(string, captures[0], captures[1]);
+        if (captures[0] == captures[1] && captures[0] == previousEnd) continue;
+        appendToBuilder(builder, string->chars + copied, captures[0] - copied);
+        int from = 0;
+        int dollar;
+        while ((dollar = findByte(replacement->chars, replacement->length, from, '$')) >= 0 &&
+               dollar + 1 < replacement->length) {
+            char c = replacement->chars[dollar + 1];
+            if (c == '$') {
+                appendToBuilder(builder, replacement->chars + from, dollar + 1 - from);
+            } else if (c >= '0' && c <= '9') {
+                appendToBuilder(builder, replacement->chars + from, dollar - from);
+                int group = c - '0';
+                if (captures[group * 2] >= 0) {
+                    appendToBuilder(builder, string->chars + captures[group * 2],
+                                    captures[group * 2 + 1] - captures[group * 2]);
+                }
+            } else {
+                appendToBuilder(builder, replacement->chars + from, dollar + 2 - from);
+            }
+            from = dollar + 2;
+        }
+        appendToBuilder(builder, replacement->chars + from, replacement->length - from);
+        copied = captures[1];
+        previousEnd = captures[1];
+    }
+    FREE_ARRAY(int, captures, capCount);
+
+    if (previousEnd < 0) {
+        pop();
+        *result = *args;
+        return false;
+    }
+    appendToBuilder(builder, string->chars + copied, string->length - copied);
+    *result = OBJ_VAL(makeString(builder->chars, builder->length));
+    pop();
+    return false;
+}
+
+static bool replaceNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a string with every occurrence of a substring or match of a regex replaced
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(replace, 3);
+    if (!IS_STRING(*args)) {
+        sprintf(errMsg, "replace expected the first argument to be a string.");
+        return true;
+    }
+    if (!IS_STRING(*(args + 1)) && !IS_REGEX(*(args + 1))) {
+        sprintf(errMsg, "replace expected the second argument to be a string or regex.");
+        return true;
+    }
+    if (!IS_STRING(*(args + 2))) {
+        sprintf(errMsg, "replace expected the third argument to be a string.");
+        return true;
+    }
+    if (IS_REGEX(*(args + 1))) {
+        return replaceRegex(args, result, errMsg);
+    }
+    ObjString* string = AS_STRING(*args);
+    ObjString* old = AS_STRING(*(args + 1));
+    ObjString* new = AS_STRING(*(args + 2));
+    if (old->length == 0) {
+        sprintf(errMsg, "replace expected a non-empty substring.");
+        return true;
+    }
+
+    int count = countBytes(string->chars, string->length, old->chars, old->length);
+    if (count == 0) {
+        *result = *args;
+        return false;
+    }
+
+    ObjString* replaced = newString(string->length + count * (new->length - old->length));
+    char* dest = replaced->chars;
+    int start = 0;
+    for (int i = 0; i < count; i++) {
+        int match = findBytes(string->chars, string->length, start, old->chars, old->length);
+        memcpy(dest, string->chars + start, match - start);
+        dest += match - start;
+        memcpy(dest, new->chars, new->length);
+        dest += new->length;
+        start = match + old->length;
+    }
+    memcpy(dest, string->chars + start, string->length - start);
+    *result = OBJ_VAL(replaced);
+    return false;
+}
+
+static bool searchNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the first match of a regex anywhere in a string and its groups, or nil
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(search, 2);
+    if (validateRegexArgs("search", args, errMsg)) {
+        return true;
+    }
+    *result = matchGroups(AS_REGEX(*args), AS_STRING(*(args + 1)), false);
+    return false;
+}
+
+static bool setNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a new set, optionally filled with the items of a list or set
+    *result = NIL_VAL;
+    if (argCount > 1) {
+        sprintf(errMsg, "set expected 0 or 1 arguments but got %d.", argCount);
+        return true;
+    }
+    if (argCount == 1 && !IS_LIST(*args) && !IS_SET(*args)) {
+        sprintf(errMsg, "set expected the argument to be a list or set.");
+        return true;
+    }
+    ObjSet* set = newSet();
+    push(OBJ_VAL(set));
+    if (argCount == 1 && IS_LIST(*args)) {
+        ObjList* list = AS_LIST(*args);
+        for (int i = 0; i < list->count; i++) {
+            if (!isHashable(list->items[i])) {
+                pop();
+                sprintf(errMsg, "set expected every item to be hashable.");
+                return true;
+            }
+            tableSet(&set->items, list->items[i], NIL_VAL);
+        }
+    } else if (argCount == 1) {
+        tableAddAll(&AS_SET(*args)->items, &set->items);
+    }
+    *result = pop();
+    return false;
+}
+
+static bool sha256Native(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the SHA-256 digest of a string, mapped file or bytes in hex
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(sha256, 1);
+    const char* chars;
+    size_t length;
+    if (validateDataArg("sha256", *args, &chars, &length, errMsg)) {
+        return true;
+    }
+    uint8_t digest[32];
+    computeSha256(chars, length, digest);
+    *result = hexValue(digest, 32);
+    return false;
+}
+
+static bool sliceNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the part of a string, list, mapped file or bytes from start up to
+    // but not including end. Both are clamped to the bounds.
     *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(slice, 3);
+    if (!IS_STRING(*args) && !IS_LIST(*args) && !IS_MAPPED(*args) && !IS_BYTES(*args)) {
+        sprintf(errMsg, "slice expected the first argument to be a string, list, mapped file, "
+                        "or bytes.");
+        return true;
+    }
+    if (!IS_NUMBER(*(args + 1)) || !IS_NUMBER(*(args + 2))) {
+        sprintf(errMsg, "slice expected start and end to be numbers.");
+        return true;
+    }
+    if (IS_BYTES(*args)) {
+        // Nothing is copied; the slice is a view of the same bytes
+        ObjBytes* bytes = AS_BYTES(*args);
+        double start = fmax(0, fmin(AS_NUMBER(*(args + 1)), bytes->length));
+        double end = fmax(start, fmin(AS_NUMBER(*(args + 2)), bytes->length));
+        *result = OBJ_VAL(newBytesView(bytes, (int)start, (int)end - (int)start));
+        return false;
+    }
+    if (IS_MAPPED(*args)) {
+        // Only the slice is copied out of the file
+        ObjMapped* mapped = AS_MAPPED(*args);
+        double start = fmax(0, fmin(AS_NUMBER(*(args + 1)), (double)mapped->length));
+        double end = fmax(start, fmin(AS_NUMBER(*(args + 2)), (double)mapped->length));
+        if (end - start > INT32_MAX) {
+            sprintf(errMsg, "slice of a mapped file is too long for a string.");
+            return true;
+        }
+        *result = OBJ_VAL(makeString(mapped->chars + (size_t)start, (int)(end - start)));
+        return false;
+    }
+    int length = IS_LIST(*args) ? AS_LIST(*args)->count : stringCharLength(*args);
+    double start = fmax(0, fmin(AS_NUMBER(*(args + 1)), length));
+    double end = fmax(start, fmin(AS_NUMBER(*(args + 2)), length));
+
+    if (IS_LIST(*args)) {
+        ObjList* list = newList();
+        push(OBJ_VAL(list));
+        reserveList(list, (int)end - (int)start);
+        ObjList* source = AS_LIST(*args);
+        for (int i = (int)start; i < (int)end; i++) {
+            appendToList(list, source->items[i]);
+        }
+        *result = pop();
+        return false;
+    }
+    ObjString* string = AS_STRING(*args);
+    int startOffset = stringCharOffset(string, (int)start);
+    int endOffset = stringCharOffset(string, (int)end);
+    *result = OBJ_VAL(makeString(string->chars + startOffset, endOffset - startOffset));
+    return false;
+}
+
+static bool splitNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a list of the parts of a string between each separator
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(split, 2);
+    if (validateStringArgs("split", 2, args, errMsg)) {
+        return true;
+    }
+    ObjString* string = AS_STRING(*args);
+    ObjString* separator = AS_STRING(*(args + 1));
+    if (separator->length == 0) {
+        sprintf(errMsg, "split expected a non-empty separator.");
+        return true;
+    }
+
+    int count = countBytes(string->chars, string->length,
+                           separator->chars, separator->length) + 1;
+    ObjList* list = newList();
+    push(OBJ_VAL(list));
+    reserveList(list, count);
+    int start = 0;
+    for (int i = 0; i < count; i++) {
+        int end = i == count - 1 ? string->length :
+            findBytes(string->chars, string->length, start,
+                      separator->chars, separator->length);
+        appendToList(list, OBJ_VAL(makeString(string->chars + start, end - start)));
+        start = end + separator->length;
+    }
+    *result = pop();
+    return false;
+}
+
+static bool startsWithNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return whether a string begins with a prefix
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(startsWith, 2);
+    if (validateStringArgs("startsWith", 2, args, errMsg)) {
+        return true;
+    }
+    ObjString* string = AS_STRING(*args);
+    ObjString* prefix = AS_STRING(*(args + 1));
+    *result = BOOL_VAL(prefix->length <= string->length &&
+                       memcmp(string->chars, prefix->chars, prefix->length) == 0);
+    return false;
+}
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool strNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Convert a number, bool, nil, string, mapped file or bytes into a string
+    VALIDATE_ARG_COUNT(str, 1);
+    Value value = *args;
+    if (IS_STRING(value)) {
+        *result = value;
+    } else if (IS_MAPPED(value) && AS_MAPPED(value)->length <= INT32_MAX) {
+        ObjMapped* mapped = AS_MAPPED(value);
+        *result = OBJ_VAL(makeString(mapped->chars, (int)mapped->length));
+    } else if (IS_BYTES(value)) {
+        ObjBytes* bytes = AS_BYTES(value);
+        *result = OBJ_VAL(makeString((const char*)bytesData(bytes), bytes->length));
+    } else if (IS_NUMBER(value)) {
+        char buffer[NUMBER_BUFFER_SIZE];
+        int length = formatNumber(AS_NUMBER(value), buffer);
+        *result = OBJ_VAL(makeString(buffer, length));
+    } else if (IS_BOOL(value)) {
+        *result = OBJ_VAL((AS_BOOL(value) ? copyString("true", 4) : copyString("false", 5)));
+    } else if (IS_NIL(value)) {
+        *result = OBJ_VAL(copyString("nil", 3));
+    } else {
+        *result = NIL_VAL;
+        sprintf(errMsg, "str expected a number, bool, nil or string.");
+        return true;
+    }
+    return false;
+}
+
+static bool sumNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the total of a number array or a list of numbers
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(sum, 1);
+    // Four running totals keep the additions from waiting on each other
+    double totals[4] = {0, 0, 0, 0};
+    int i = 0;
+    if (IS_NUMBERS(*args)) {
+        ObjNumbers* numbers = AS_NUMBERS(*args);
+        for (; i + 4 <= numbers->count; i += 4) {
+            for (int j = 0; j < 4; j++) totals[j] += numbers->items[i + j];
+        }
+        for (; i < numbers->count; i++) totals[0] += numbers->items[i];
+    } else if (IS_LIST(*args)) {
+        ObjList* list = AS_LIST(*args);
+        for (; i < list->count; i++) {
+            if (!IS_NUMBER(list->items[i])) {
+                sprintf(errMsg, "sum expected every item to be a number.");
+                return true;
+            }
+            totals[i % 4] += AS_NUMBER(list->items[i]);
+        }
+    } else {
+        sprintf(errMsg, "sum expected a list or number array.");
+        return true;
+    }
+    *result = NUMBER_VAL((totals[0] + totals[1]) + (totals[2] + totals[3]));
+    return false;
+}
+
+static bool trimNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a string without leading or trailing whitespace
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(trim, 1);
+    if (validateStringArgs("trim", 1, args, errMsg)) {
+        return true;
+    }
+    ObjString* string = AS_STRING(*args);
+    int start = 0;
+    int end = string->length;
+    while (start < end && isSpace(string->chars[start])) start++;
+    while (end > start && isSpace(string->chars[end - 1])) end--;
+
+    if (start == 0 && end == string->length) {
+        *result = *args;
+    } else {
+        *result = OBJ_VAL(makeString(string->chars + start, end - start));
+    }
+    return false;
+}
+
+static bool unionNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return a new set of the items in either set
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(union, 2);
+    if (validateSetArgs("union", args, errMsg)) {
+        return true;
+    }
+    ObjSet* set = newSet();
+    push(OBJ_VAL(set));
+    tableAddAll(&AS_SET(*args)->items, &set->items);
+    tableAddAll(&AS_SET(*(args + 1))->items, &set->items);
+    *result = pop();
+    return false;
+}
+
+static bool unpackNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Read a number from bytes at an offset in a binary layout such as 'u32'
+    // or 'f64'. 64-bit integers beyond 2^53 come back rounded.
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(unpack, 3);
+    const PackType* type;
+    if (validatePackArgs("unpack", args, &type, errMsg)) {
+        return true;
+    }
+    ObjBytes* bytes = AS_BYTES(*args);
+    int offset = (int)AS_NUMBER(*(args + 1));
+    if (offset > bytes->length - type->size) {
+        sprintf(errMsg, "unpack offset out of range.");
+        return true;
+    }
+    const uint8_t* in = bytesData(bytes) + offset;
+    uint64_t bits = 0;
+    for (int i = 0; i < type->size; i++) bits |= (uint64_t)in[i] << (i * 8);
+
+    if (type->isFloat && type->size == 4) {
+        uint32_t singleBits = (uint32_t)bits;
+        float single;
+        memcpy(&single, &singleBits, 4);
+        *result = NUMBER_VAL(single);
+    } else if (type->isFloat) {
+        double value;
+        memcpy(&value, &bits, 8);
+        *result = NUMBER_VAL(value);
+    } else if (type->isSigned) {
+        // Sign-extend from the top bit of the field
+        int shift = 64 - type->size * 8;
+        *result = NUMBER_VAL((double)((int64_t)(bits << shift) >> shift));
+    } else {
+        *result = NUMBER_VAL((double)bits);
+    }
     return false;
 }
 
 static bool valuesNative(int argCount, Value* args, Value* result, char errMsg[]) {
-    // Return a list of the values in a map
+    // Return a list of the values in a map or the items in a set
     VALIDATE_ARG_COUNT(values, 1);
+    if (IS_SET(*args)) {
+        ObjSet* set = AS_SET(*args);
+        ObjList* itemsList = newList();
+        push(OBJ_VAL(itemsList));
+        for (int i = 0; i < set->items.entryCount; i++) {
+            if (!set->items.entries[i].empty) {
+                appendToList(itemsList, set->items.entries[i].key);
+            }
+        }
+        *result = pop();
+        return false;
+    }
     if (!IS_MAP(*args)) {
-        sprintf(errMsg, "values expected the first argument to be a map.");
+        sprintf(errMsg, "values expected the first argument to be a map or set.");
         return true;
     }
     ObjMap* map = AS_MAP(*args);
@@ -294,11 +1590,10 @@ static bool valuesNative(int argCount, Value* args, Value* result, char errMsg[]
     Value valuesValue = OBJ_VAL(valuesList);
     push(valuesValue);
 
-    for (int i = 0; i < map->items.capacity; i++) {
-        if (map->items.entries[i].empty) {
-            continue;
-        }
-        appendToList(valuesList, map->items.entries[i].value);
+    int cursor = 0;
+    Value key, value;
+    while (nextInMap(map, &cursor, &key, &value)) {
+        appendToList(valuesList, value);
     }
 
     pop();
@@ -309,7 +1604,8 @@ static bool valuesNative(int argCount, Value* args, Value* result, char errMsg[]
 static bool writeNative(int argCount, Value* args, Value* result, char errMsg[]) {
     VALIDATE_ARG_COUNT(write, 1);
     if (IS_STRING(*args)) {
-        printf("%s", AS_CSTRING(*args));
+        ObjString* string = AS_STRING(*args);
+        writeOutput(string->chars, string->length);
     } else {
         printValue(*args);
     }
@@ -317,6 +1613,56 @@ static bool writeNative(int argCount, Value* args, Value* result, char errMsg[])
     return false;
 }
 
+static bool writeFileNative(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Replace the contents of a file with a string, mapped file or bytes
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(writeFile, 2);
+    if (validateStringArgs("writeFile", 1, args, errMsg)) {
+        return true;
+    }
+    Value contents = *(args + 1);
+    const char* chars;
+    size_t length;
+    if (IS_STRING(contents)) {
+        ObjString* string = AS_STRING(contents);
+        chars = string->chars;
+        length = string->length;
+    } else if (IS_MAPPED(contents)) {
+        chars = AS_MAPPED(contents)->chars;
+        length = AS_MAPPED(contents)->length;
+    } else if (IS_BYTES(contents)) {
+        chars = (const char*)bytesData(AS_BYTES(contents));
+        length = AS_BYTES(contents)->length;
+    } else {
+        sprintf(errMsg, "writeFile expected the second argument to be a string, mapped file or "
+                        "bytes.");
+        return true;
+    }
+    const char* path = AS_CSTRING(*args);
+    if (!writeWholeFile(path, chars, length)) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "writeFile could not write '%s'.", path);
+        return true;
+    }
+    return false;
+}
+
+static bool xxhash64Native(int argCount, Value* args, Value* result, char errMsg[]) {
+    // Return the 64-bit xxHash of a string, mapped file or bytes in hex, since
+    // it doesn't fit in a number
+    *result = NIL_VAL;
+    VALIDATE_ARG_COUNT(xxhash64, 1);
+    const char* chars;
+    size_t length;
+    if (validateDataArg("xxhash64", *args, &chars, &length, errMsg)) {
+        return true;
+    }
+    uint64_t hash = computeXxhash64(chars, length, 0);
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++) bytes[i] = (uint8_t)(hash >> (56 - i * 8));
+    *result = hexValue(bytes, 8);
+    return false;
+}
+
 static void defineNative(VM* vm, const char* name, NativeFn function) {
     push(OBJ_VAL(copyString(name, (int)strlen(name))));
     push(OBJ_VAL(newNative(function)));
@@ -326,19 +1672,68 @@ static void defineNative(VM* vm, const char* name, NativeFn function) {
 }
 
 void defineNatives(VM* vm) {
+    defineNative(vm, "add", addNative);
     defineNative(vm, "append", appendNative);
+    defineNative(vm, "appendNumber", appendNumberNative);
     defineNative(vm, "assert", assertNative);
+    defineNative(vm, "bench", benchNative);
+    defineNative(vm, "build", buildNative);
+    defineNative(vm, "builder", builderNative);
+    defineNative(vm, "bytes", bytesNative);
     defineNative(vm, "clock", clockNative);
+    defineNative(vm, "close", closeNative);
+    defineNative(vm, "compress", compressNative);
+    defineNative(vm, "compressFile", compressFileNative);
+    defineNative(vm, "count", countNative);
+    defineNative(vm, "cpuTime", cpuTimeNative);
+    defineNative(vm, "crc32", crc32Native);
+    defineNative(vm, "decompress", decompressNative);
+    defineNative(vm, "decompressFile", decompressFileNative);
     defineNative(vm, "delete", deleteNative);
+    defineNative(vm, "difference", differenceNative);
+    defineNative(vm, "find", findNative);
+    defineNative(vm, "findAll", findAllNative);
+    defineNative(vm, "flush", flushNative);
     defineNative(vm, "has", hasNative);
     defineNative(vm, "input", inputNative);
+    defineNative(vm, "intersection", intersectionNative);
     defineNative(vm, "items", itemsNative);
+    defineNative(vm, "join", joinNative);
+    defineNative(vm, "jsonParse", jsonParseNative);
+    defineNative(vm, "jsonStringify", jsonStringifyNative);
     defineNative(vm, "keys", keysNative);
     defineNative(vm, "len", lenNative);
+    defineNative(vm, "lines", linesNative);
+    defineNative(vm, "match", matchNative);
+    defineNative(vm, "md5", md5Native);
+    defineNative(vm, "next", nextNative);
+    defineNative(vm, "now", nowNative);
     defineNative(vm, "num", numNative);
+    defineNative(vm, "open", openNative);
+    defineNative(vm, "openMapped", openMappedNative);
+    defineNative(vm, "pack", packNative);
     defineNative(vm, "print", printNative);
+    defineNative(vm, "readAll", readAllNative);
+    defineNative(vm, "readCsv", readCsvNative);
+    defineNative(vm, "readCsvColumns", readCsvColumnsNative);
+    defineNative(vm, "readFile", readFileNative);
+    defineNative(vm, "regex", regexNative);
+    defineNative(vm, "replace", replaceNative);
+    defineNative(vm, "search", searchNative);
+    defineNative(vm, "set", setNative);
+    defineNative(vm, "sha256", sha256Native);
+    defineNative(vm, "slice", sliceNative);
+    defineNative(vm, "split", splitNative);
+    defineNative(vm, "startsWith", startsWithNative);
+    defineNative(vm, "str", strNative);
+    defineNative(vm, "sum", sumNative);
+    defineNative(vm, "trim", trimNative);
+    defineNative(vm, "union", unionNative);
+    defineNative(vm, "unpack", unpackNative);
     defineNative(vm, "values", valuesNative);
     defineNative(vm, "write", writeNative);
+    defineNative(vm, "writeFile", writeFileNative);
+    defineNative(vm, "xxhash64", xxhash64Native);
 }
 
 #undef VALIDATE_ARG_COUNT
@@ -0,0 +1,12 @@
+#ifndef nqq_number_h
+#define nqq_number_h
+
+#include "common.h"
+
+// Big enough for any number formatNumber writes, plus the terminator
+#define NUMBER_BUFFER_SIZE 32
+
+int formatNumber(double value, char* buffer);
+bool parseNumber(const char* chars, int length, double* result);
+
+#endif
@@ -1,8 +1,11 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "file.h"
 #include "memory.h"
 #include "object.h"
+#include "output.h"
+#include "search.h"
 #include "table.h"
 #include "value.h"
 #include "vm.h"
@@ -10,6 +13,9 @@
 #define ALLOCATE_OBJ(type, objectType) \
     (type*)allocateObject(sizeof(type), objectType)
 
+// Maps with more string keys than this are treated as plain dictionaries
+#define SHAPE_MAX_KEYS 64
+
 static Obj* allocateObject(size_t size, ObjType type) {
     Obj* object = (Obj*)reallocate(NULL, 0, size);
     object->type = type;
@@ -63,6 +69,15 @@ ObjList* newList() {
     return list;
 }
 
+void reserveList(ObjList* list, int capacity) {
+    // Make room for at least capacity items so appending that many never
+    // allocates. Expects list is already trackable by GC i.e. on stack.
+    if (list->capacity < capacity) {
+        list->items = GROW_ARRAY(list->items, Value, list->capacity, capacity);
+        list->capacity = capacity;
+    }
+}
+
 void appendToList(ObjList* list, Value value) {
     // Add an item to the end of a list.
     // Length of list will grow by 1 from users perspective.
@@ -106,53 +121,226 @@ bool isValidListIndex(ObjList* list, int index) {
     return true;
 }
 
+// Bytes in the UTF-8 sequence starting at chars. Bytes that don't start a
+// valid sequence count as a character each.
+static int charWidth(const char* chars, int remaining) {
+    uint8_t lead = (uint8_t)chars[0];
+    int width;
+    if (lead < 0x80) return 1;
+    else if (lead >= 0xC2 && lead <= 0xDF) width = 2;
+    else if (lead >= 0xE0 && lead <= 0xEF) width = 3;
+    else if (lead >= 0xF0 && lead <= 0xF4) width = 4;
+    else return 1;
+
+    if (width > remaining) return 1;
+    for (int i = 1; i < width; i++) {
+        if (((uint8_t)chars[i] & 0xC0) != 0x80) return 1;
+    }
+    return width;
+}
+
+static void scanString(ObjString* string) {
+    if (string->scanned) return;
+    string->ascii = isAscii(string->chars, string->length);
+    if (string->ascii) {
+        string->charCount = string->length;
+    } else {
+        int count = 0;
+        for (int i = 0; i < string->length; i += charWidth(string->chars + i, string->length - i)) {
+            count++;
+        }
+        string->charCount = count;
+    }
+    string->scanned = true;
+}
+
+int stringCharLength(Value value) {
+    if (AS_OBJ(value)->type == OBJ_ROPE) return AS_ROPE(value)->charCount;
+    ObjString* string = (ObjString*)AS_OBJ(value);
+    scanString(string);
+    return string->charCount;
+}
+
+// Byte offset of codepoint index, which may be one past the last. Builds the
+// offsets table so expects string is reachable by the GC i.e. on the stack.
+int stringCharOffset(ObjString* string, int index) {
+    scanString(string);
+    if (string->ascii) return index;
+    if (index >= string->charCount) return string->length;
+
+    if (string->offsets == NULL) {
+        int entries = (string->charCount - 1) / STRING_INDEX_STRIDE + 1;
+        int* offsets = ALLOCATE(int, entries);
+        int count = 0;
+        for (int i = 0; i < string->length; i += charWidth(string->chars + i, string->length - i)) {
+            if (count % STRING_INDEX_STRIDE == 0) offsets[count / STRING_INDEX_STRIDE] = i;
+            count++;
+        }
+        string->offsets = offsets;
+    }
+
+    int offset = string->offsets[index / STRING_INDEX_STRIDE];
+    for (int i = index % STRING_INDEX_STRIDE; i > 0; i--) {
+        offset += charWidth(string->chars + offset, string->length - offset);
+    }
+    return offset;
+}
+
+// Codepoint index of the character starting at byte offset.
+int stringCharIndex(ObjString* string, int offset) {
+    scanString(string);
+    if (string->ascii) return offset;
+
+    int index = 0;
+    for (int i = 0; i < offset; i += charWidth(string->chars + i, string->length - i)) {
+        index++;
+    }
+    return index;
+}
+
 bool isValidStringIndex(ObjString* string, int index) {
-    if (index < 0 || index > string->length - 1) {
+    scanString(string);
+    if (index < 0 || index > string->charCount - 1) {
         return false;
     }
     return true;
 }
 
+// Index is assumed to be valid. Expects string is reachable by the GC.
 Value indexFromString(ObjString* string, int index) {
-    ObjString* newString = copyString((char*)(string->chars + index), 1);
-    return OBJ_VAL(newString);
+    scanString(string);
+    if (string->ascii) return OBJ_VAL(vm.characters[(uint8_t)string->chars[index]]);
+
+    int offset = stringCharOffset(string, index);
+    int width = charWidth(string->chars + offset, string->length - offset);
+    return OBJ_VAL(makeString(string->chars + offset, width));
 }
 
-static ObjString* allocateString(char* chars, int length, uint32_t hash) {
-    ObjString* string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+// Allocate an uninterned string with room for length characters for the
+// caller to fill in. Its hash is computed on first use.
+ObjString* newString(int length) {
+    ObjString* string = (ObjString*)allocateObject(
+        sizeof(ObjString) + length + 1, OBJ_STRING);
     string->length = length;
-    string->chars = chars;
-    string->hash = hash;
+    string->hash = 0;
+    string->hashed = false;
+    string->interned = false;
+    string->scanned = false;
+    string->ascii = false;
+    string->charCount = 0;
+    string->offsets = NULL;
+    string->chars[length] = '\0';
+    return string;
+}
 
-    push(OBJ_VAL(string));
-    tableSet(&vm.strings, OBJ_VAL(string), NIL_VAL);
-    pop();
+// Like copyString but for strings made at runtime, which aren't interned.
+ObjString* makeString(const char* chars, int length) {
+    if (length == 1) return vm.characters[(uint8_t)chars[0]];
 
+    ObjString* string = newString(length);
+    memcpy(string->chars, chars, length);
     return string;
 }
 
-// Copy a string to strings table and take ownership of memory
-ObjString* takeString(char* chars, int length) {
-    uint32_t hash = hashBytes((uint8_t*)chars, length);
-    ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
-    if (interned != NULL) {
-        FREE_ARRAY(char, chars, length + 1);
-        return interned;
+uint32_t hashString(ObjString* string) {
+    if (!string->hashed) {
+        string->hash = hashBytes((uint8_t*)string->chars, string->length);
+        string->hashed = true;
     }
-    return allocateString(chars, length, hash);
+    return string->hash;
+}
+
+ObjRope* newRope(Obj* left, Obj* right) {
+    ObjRope* rope = ALLOCATE_OBJ(ObjRope, OBJ_ROPE);
+    rope->length = stringLength(OBJ_VAL(left)) + stringLength(OBJ_VAL(right));
+    rope->charCount = stringCharLength(OBJ_VAL(left)) + stringCharLength(OBJ_VAL(right));
+    rope->left = left;
+    rope->right = right;
+    rope->flat = NULL;
+    return rope;
+}
+
+static void copyRope(Obj* node, char* end) {
+    // Copy the characters of node so they finish just before end. Only the
+    // shorter half is recursed into so the depth stays logarithmic even for
+    // ropes built one piece at a time.
+    for (;;) {
+        if (node->type == OBJ_STRING) {
+            ObjString* string = (ObjString*)node;
+            memcpy(end - string->length, string->chars, string->length);
+            return;
+        }
+        ObjRope* rope = (ObjRope*)node;
+        if (rope->flat != NULL) {
+            memcpy(end - rope->length, rope->flat->chars, rope->length);
+            return;
+        }
+        int rightLength = stringLength(OBJ_VAL(rope->right));
+        if (rope->length - rightLength < rightLength) {
+            copyRope(rope->left, end - rightLength);
+            node = rope->right;
+        } else {
+            copyRope(rope->right, end);
+            end -= rightLength;
+            node = rope->left;
+        }
+    }
+}
+
+// Rope is expected to be reachable by the GC i.e. on the stack.
+ObjString* flattenRope(ObjRope* rope) {
+    if (rope->flat == NULL) {
+        ObjString* flat = newString(rope->length);
+        copyRope((Obj*)rope, flat->chars + rope->length);
+        rope->flat = flat;
+        rope->left = NULL;
+        rope->right = NULL;
+    }
+    return rope->flat;
+}
+
+// Copies the characters of a string or rope to dest, leaving a rope as it is.
+void writeString(Value value, char* dest) {
+    copyRope(AS_OBJ(value), dest + stringLength(value));
+}
+
+bool stringsEqual(ObjString* a, ObjString* b) {
+    if (a == b) return true;
+    // Two distinct interned strings always differ
+    if (a->interned && b->interned) return false;
+    if (a->length != b->length) return false;
+    if (a->hashed && b->hashed && a->hash != b->hash) return false;
+    return memcmp(a->chars, b->chars, a->length) == 0;
+}
+
+// Copy a string to strings table and free the buffer it came from
+ObjString* takeString(char* chars, int length) {
+    ObjString* string = copyString(chars, length);
+    FREE_ARRAY(char, chars, length + 1);
+    return string;
 }
 
 // Copy a string to strings table without taking ownership of memory
 ObjString* copyString(const char* chars, int length) {
+    if (length == 1 && vm.characters[(uint8_t)chars[0]] != NULL) {
+        return vm.characters[(uint8_t)chars[0]];
+    }
+
     uint32_t hash = hashBytes((uint8_t*)chars, length);
     ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
     if (interned != NULL) return interned;
 
-    char* heapChars = ALLOCATE(char, length + 1);
-    memcpy(heapChars, chars, length);
-    heapChars[length] = '\0';
+    ObjString* string = newString(length);
+    memcpy(string->chars, chars, length);
+    string->hash = hash;
+    string->hashed = true;
+    string->interned = true;
 
-    return allocateString(heapChars, length, hash);
+    push(OBJ_VAL(string));
+    tableSet(&vm.strings, OBJ_VAL(string), NIL_VAL);
+    pop();
+
+    return string;
 }
 
 ObjUpvalue* newUpvalue(Value* slot) {
@@ -165,63 +353,501 @@ ObjUpvalue* newUpvalue(Value* slot) {
 
 ObjMap* newMap() {
     ObjMap* map = ALLOCATE_OBJ(ObjMap, OBJ_MAP);
+    map->shape = vm.emptyShape;
+    map->arrayCount = 0;
+    map->arrayLength = 0;
+    map->arrayCapacity = 0;
+    map->array = NULL;
     initTable(&map->items);
     return map;
 }
 
+ObjShape* newShape(ObjShape* parent, ObjString* key) {
+    ObjShape* shape = ALLOCATE_OBJ(ObjShape, OBJ_SHAPE);
+    shape->parent = parent;
+    shape->key = key;
+    shape->count = parent == NULL ? 0 : parent->count + 1;
+    initTable(&shape->transitions);
+    return shape;
+}
+
+static ObjShape* transitionShape(ObjShape* shape, ObjString* key) {
+    // Find or create the shape reached by adding key to a map with shape.
+    Value child;
+    if (tableGet(&shape->transitions, OBJ_VAL(key), &child)) {
+        return AS_SHAPE(child);
+    }
+    if (shape->count == SHAPE_MAX_KEYS) return NULL;
+
+    ObjShape* newChild = newShape(shape, key);
+    push(OBJ_VAL(newChild));
+    tableSet(&shape->transitions, OBJ_VAL(key), OBJ_VAL(newChild));
+    pop();
+    return newChild;
+}
+
+ObjBuilder* newBuilder() {
+    ObjBuilder* builder = ALLOCATE_OBJ(ObjBuilder, OBJ_BUILDER);
+    builder->length = 0;
+    builder->capacity = 0;
+    builder->chars = NULL;
+    return builder;
+}
+
+void appendToBuilder(ObjBuilder* builder, const char* chars, int length) {
+    // Expects builder is already trackable by GC i.e. on stack.
+    if (builder->capacity < builder->length + length) {
+        int oldCapacity = builder->capacity;
+        int capacity = oldCapacity;
+        while (capacity < builder->length + length) {
+            capacity = GROW_CAPACITY(capacity);
+        }
+        builder->chars = GROW_ARRAY(builder->chars, char, oldCapacity, capacity);
+        builder->capacity = capacity;
+    }
+    memcpy(builder->chars + builder->length, chars, length);
+    builder->length += length;
+}
+
+ObjBytes* newBytes(int length) {
+    uint8_t* data = length > 0 ? ALLOCATE(uint8_t, length) : NULL;
+    if (length > 0) memset(data, 0, length);
+    return takeBytes(data, length, length);
+}
+
+ObjBytes* takeBytes(uint8_t* data, int length, int capacity) {
+    // Takes ownership of data, which must have come from ALLOCATE
+    ObjBytes* bytes = ALLOCATE_OBJ(ObjBytes, OBJ_BYTES);
+    bytes->length = length;
+    bytes->capacity = capacity;
+    bytes->bytes = data;
+    bytes->owner = NULL;
+    bytes->offset = 0;
+    return bytes;
+}
+
+ObjBytes* newBytesView(ObjBytes* bytes, int offset, int length) {
+    // Expects bytes is already trackable by GC i.e. on stack.
+    // A view of a view looks straight into the owner
+    if (bytes->owner != NULL) {
+        offset += bytes->offset;
+        bytes = bytes->owner;
+    }
+    ObjBytes* view = ALLOCATE_OBJ(ObjBytes, OBJ_BYTES);
+    view->length = length;
+    view->capacity = 0;
+    view->bytes = NULL;
+    view->owner = bytes;
+    view->offset = offset;
+    return view;
+}
+
+void resizeBytes(ObjBytes* bytes, int length) {
+    // Expects bytes owns its storage and is trackable by GC. New bytes are zero.
+    if (bytes->capacity < length) {
+        int oldCapacity = bytes->capacity;
+        size_t capacity = (size_t)oldCapacity;
+        while (capacity < (size_t)length) {
+            capacity = GROW_CAPACITY(capacity);
+        }
+        if (capacity > INT32_MAX) capacity = INT32_MAX;
+        bytes->bytes = GROW_ARRAY(bytes->bytes, uint8_t, oldCapacity, capacity);
+        bytes->capacity = (int)capacity;
+    }
+    if (length > bytes->length) {
+        memset(bytes->bytes + bytes->length, 0, length - bytes->length);
+    }
+    bytes->length = length;
+}
+
+void appendToBytes(ObjBytes* bytes, const char* chars, size_t length) {
+    // Expects bytes owns its storage and is trackable by GC. chars may point
+    // into bytes itself, which growing moves.
+    const uint8_t* source = (const uint8_t*)chars;
+    bool inside = bytes->bytes != NULL && source >= bytes->bytes &&
+                  source < bytes->bytes + bytes->capacity;
+    size_t offset = inside ? (size_t)(source - bytes->bytes) : 0;
+    int start = bytes->length;
+    resizeBytes(bytes, start + (int)length);
+    if (inside) source = bytes->bytes + offset;
+    memmove(bytes->bytes + start, source, length);
+}
+
+ObjFile* newFile(int fd) {
+    ObjFile* file = ALLOCATE_OBJ(ObjFile, OBJ_FILE);
+    initReader(&file->reader, fd);
+    file->closed = false;
+    vm.openFiles++;
+    return file;
+}
+
+void closeFile(ObjFile* file) {
+    if (file->closed) return;
+    closeDescriptor(file->reader.fd);
+    freeReader(&file->reader);
+    // Reads from now on find the end straight away
+    file->reader.eof = true;
+    file->closed = true;
+    vm.openFiles--;
+}
+
+ObjLines* newLines(Reader* reader, Obj* source) {
+    ObjLines* lines = ALLOCATE_OBJ(ObjLines, OBJ_LINES);
+    lines->reader = reader;
+    lines->source = source;
+    return lines;
+}
+
+ObjMapped* newMapped(char* chars, size_t length) {
+    ObjMapped* mapped = ALLOCATE_OBJ(ObjMapped, OBJ_MAPPED);
+    mapped->chars = chars;
+    mapped->length = length;
+    return mapped;
+}
+
+ObjNumbers* newNumbers() {
+    ObjNumbers* numbers = ALLOCATE_OBJ(ObjNumbers, OBJ_NUMBERS);
+    numbers->items = NULL;
+    numbers->count = 0;
+    numbers->capacity = 0;
+    return numbers;
+}
+
+void appendToNumbers(ObjNumbers* numbers, double number) {
+    // Expects numbers is already trackable by GC i.e. on stack.
+    if (numbers->capacity < numbers->count + 1) {
+        int oldCapacity = numbers->capacity;
+        numbers->capacity = GROW_CAPACITY(oldCapacity);
+        numbers->items = GROW_ARRAY(numbers->items, double, oldCapacity, numbers->capacity);
+    }
+    numbers->items[numbers->count++] = number;
+}
+
+ObjRegex* newRegex(Regex* regex) {
+    ObjRegex* object = ALLOCATE_OBJ(ObjRegex, OBJ_REGEX);
+    object->regex = regex;
+    return object;
+}
+
+ObjSet* newSet() {
+    ObjSet* set = ALLOCATE_OBJ(ObjSet, OBJ_SET);
+    initTable(&set->items);
+    return set;
+}
+
+bool isInSet(ObjSet* set, Value item) {
+    // Item is assumed to be hashable.
+    return tableFindIndex(&set->items, item) != -1;
+}
+
+bool setsEqual(ObjSet* a, ObjSet* b) {
+    if (a->items.count != b->items.count) {
+        return false;
+    }
+    for (int i = 0; i < a->items.entryCount; i++) {
+        Entry* entry = &a->items.entries[i];
+        if (!entry->empty && !isInSet(b, entry->key)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool arrayIndexFromKey(Value key, int* index) {
+    if (!IS_NUMBER(key)) return false;
+
+    double number = AS_NUMBER(key);
+    if (!(number >= 0 && number < INT32_MAX) || number != (int)number) {
+        return false;
+    }
+    *index = (int)number;
+    return true;
+}
+
+static void growArrayPart(ObjMap* map, int length) {
+    int oldCapacity = map->arrayCapacity;
+    int capacity = oldCapacity;
+    while (capacity < length) {
+        capacity = GROW_CAPACITY(capacity);
+    }
+    map->array = GROW_ARRAY(map->array, Value, oldCapacity, capacity);
+    for (int i = oldCapacity; i < capacity; i++) {
+        map->array[i] = EMPTY_VAL;
+    }
+    map->arrayCapacity = capacity;
+}
+
+static void migrateToItems(ObjMap* map) {
+    // Move the whole array part into items. Only called while items is empty
+    // so the array keys still come first.
+    for (int i = 0; i < map->arrayLength; i++) {
+        if (IS_EMPTY(map->array[i])) continue;
+        tableSet(&map->items, NUMBER_VAL(i), map->array[i]);
+    }
+    FREE_ARRAY(Value, map->array, map->arrayCapacity);
+    map->array = NULL;
+    map->arrayCount = 0;
+    map->arrayLength = 0;
+    map->arrayCapacity = 0;
+}
+
+static void migrateToArrayPart(ObjMap* map) {
+    // Move the leading run of ascending integer keys in items over to the
+    // array part, as long as the array part stays more than half full. They
+    // follow the keys already in the array part so the order is unchanged.
+    int taken = 0;
+    int length = map->arrayLength;
+    int scanned = 0;
+    int previous = map->arrayLength - 1;
+    for (int i = 0; i < map->items.entryCount; i++) {
+        Entry* entry = &map->items.entries[i];
+        if (entry->empty) continue;
+
+        int index;
+        if (!arrayIndexFromKey(entry->key, &index) || index <= previous) break;
+        previous = index;
+        scanned++;
+        if ((map->arrayCount + scanned) * 2 > index + 1) {
+            taken = scanned;
+            length = index + 1;
+        }
+    }
+    if (taken == 0) return;
+
+    growArrayPart(map, length);
+    for (int i = 0; taken > 0; i++) {
+        Entry* entry = &map->items.entries[i];
+        if (entry->empty) continue;
+
+        int index = (int)AS_NUMBER(entry->key);
+        map->array[index] = entry->value;
+        map->arrayCount++;
+        tableDelete(&map->items, entry->key);
+        taken--;
+    }
+    map->arrayLength = length;
+}
+
+bool indexFromMap(ObjMap* map, Value key, Value* value) {
+    // Key is assumed to be hashable.
+    int index;
+    if (arrayIndexFromKey(key, &index) && index < map->arrayLength &&
+        !IS_EMPTY(map->array[index])) {
+        *value = map->array[index];
+        return true;
+    }
+    return tableGet(&map->items, key, value);
+}
+
+void storeToMap(ObjMap* map, Value key, Value value) {
+    // Key is assumed to be hashable.
+    // Expects map, key and value are already trackable by GC i.e. on stack.
+    int index;
+    if (arrayIndexFromKey(key, &index)) {
+        if (index < map->arrayLength && !IS_EMPTY(map->array[index])) {
+            map->array[index] = value;
+            return;
+        }
+        if (index == map->arrayLength && map->items.count == 0) {
+            map->shape = NULL;
+            if (index == map->arrayCapacity && map->arrayCount * 2 < map->arrayLength) {
+                // Too sparse to be worth growing
+                migrateToItems(map);
+            } else {
+                if (index == map->arrayCapacity) growArrayPart(map, index + 1);
+                map->array[index] = value;
+                map->arrayCount++;
+                map->arrayLength++;
+                return;
+            }
+        }
+    }
+
+    if (map->shape == NULL && tableIsFull(&map->items) &&
+        tableFindIndex(&map->items, key) == -1) {
+        // Items is about to be rebuilt anyway
+        migrateToArrayPart(map);
+        if (arrayIndexFromKey(key, &index) && index == map->arrayLength &&
+            map->items.count == 0) {
+            storeToMap(map, key, value);
+            return;
+        }
+    }
+
+    bool isNewKey = tableSet(&map->items, key, value);
+    if (isNewKey && map->shape != NULL) {
+        map->shape = IS_STRING(key) ? transitionShape(map->shape, AS_STRING(key)) : NULL;
+    }
+}
+
+bool deleteFromMap(ObjMap* map, Value key) {
+    // Key is assumed to be hashable.
+    // Deleting leaves a hole in the entries so the map can't keep its shape.
+    int index;
+    if (arrayIndexFromKey(key, &index) && index < map->arrayLength &&
+        !IS_EMPTY(map->array[index])) {
+        map->array[index] = EMPTY_VAL;
+        map->arrayCount--;
+        while (map->arrayLength > 0 && IS_EMPTY(map->array[map->arrayLength - 1])) {
+            map->arrayLength--;
+        }
+        return true;
+    }
+
+    bool deleted = tableDelete(&map->items, key);
+    if (deleted) map->shape = NULL;
+    return deleted;
+}
+
+int countMap(ObjMap* map) {
+    return map->arrayCount + map->items.count;
+}
+
+// Steps through a map in insertion order. Start with *cursor at 0 and keep
+// calling until it returns false.
+bool nextInMap(ObjMap* map, int* cursor, Value* key, Value* value) {
+    while (*cursor < map->arrayLength) {
+        int index = (*cursor)++;
+        if (IS_EMPTY(map->array[index])) continue;
+        *key = NUMBER_VAL(index);
+        *value = map->array[index];
+        return true;
+    }
+    while (*cursor - map->arrayLength < map->items.entryCount) {
+        Entry* entry = &map->items.entries[(*cursor)++ - map->arrayLength];
+        if (entry->empty) continue;
+        *key = entry->key;
+        *value = entry->value;
+        return true;
+    }
+    return false;
+}
+
 static void printFunction(ObjFunction* function) {
     if (function->name == NULL) {
-        printf("<script>");
+        WRITE_LITERAL("<script>");
         return;
     }
-    printf("<fn %s>", function->name->chars);
+    WRITE_LITERAL("<fn ");
+    writeOutput(function->name->chars, function->name->length);
+    WRITE_LITERAL(">");
 }
 
 static void printList(ObjList* list) {
-    printf("[");
+    WRITE_LITERAL("[");
     for (int i = 0; i < list->count - 1; i++) {
         printValue(list->items[i]);
-        printf(", ");
+        WRITE_LITERAL(", ");
     }
     if (list->count != 0) {
         printValue(list->items[list->count - 1]);
     }
-    printf("]");
+    WRITE_LITERAL("]");
+}
+
+static void printNumbers(ObjNumbers* numbers) {
+    WRITE_LITERAL("[");
+    for (int i = 0; i < numbers->count; i++) {
+        if (i > 0) WRITE_LITERAL(", ");
+        writeNumber(numbers->items[i]);
+    }
+    WRITE_LITERAL("]");
+}
+
+static void printBytes(ObjBytes* bytes) {
+    static const char digits[] = "0123456789abcdef";
+    const uint8_t* data = bytesData(bytes);
+    WRITE_LITERAL("<bytes");
+    for (int i = 0; i < bytes->length; i++) {
+        char hex[3] = {' ', digits[data[i] >> 4], digits[data[i] & 0xF]};
+        writeOutput(hex, 3);
+    }
+    WRITE_LITERAL(">");
 }
 
 static void printMap(ObjMap* map) {
     bool first = true;
-    printf("{");
-    for (int i = 0; i < map->items.capacity; i++) {
-        if (!map->items.entries[i].empty) {
-            if (!first) {
-                printf(", ");
-            }
-            first = false;
-            printValue(map->items.entries[i].key);
-            printf(": ");
-            printValue(map->items.entries[i].value);
+    WRITE_LITERAL("{");
+    int cursor = 0;
+    Value key, value;
+    while (nextInMap(map, &cursor, &key, &value)) {
+        if (!first) {
+            WRITE_LITERAL(", ");
+        }
+        first = false;
+        printValue(key);
+        WRITE_LITERAL(": ");
+        printValue(value);
+    }
+    WRITE_LITERAL("}");
+}
+
+static void printSet(ObjSet* set) {
+    if (set->items.count == 0) {
+        // {} is an empty map
+        WRITE_LITERAL("set()");
+        return;
+    }
+    bool first = true;
+    WRITE_LITERAL("{");
+    for (int i = 0; i < set->items.entryCount; i++) {
+        if (set->items.entries[i].empty) {
+            continue;
         }
+        if (!first) {
+            WRITE_LITERAL(", ");
+        }
+        first = false;
+        printValue(set->items.entries[i].key);
     }
-    printf("}");
+    WRITE_LITERAL("}");
 }
 
 void printObject(Value value) {
     switch (OBJ_TYPE(value)) {
+        case OBJ_BUILDER:
+            WRITE_LITERAL("<builder>");
+            break;
+        case OBJ_BYTES:
+            printBytes(AS_BYTES(value));
+            break;
         case OBJ_CLOSURE:
             printFunction(AS_CLOSURE(value)->function);
             break;
+        case OBJ_FILE:
+            WRITE_LITERAL("<file>");
+            break;
         case OBJ_FUNCTION:
             printFunction(AS_FUNCTION(value));
             break;
+        case OBJ_LINES:
+            WRITE_LITERAL("<lines>");
+            break;
+        case OBJ_MAPPED:
+            WRITE_LITERAL("<mapped file>");
+            break;
         case OBJ_NATIVE:
-            printf("<native fn>");
+            WRITE_LITERAL("<native fn>");
             break;
-        case OBJ_STRING:
-            printf("'%s'", AS_CSTRING(value));
+        case OBJ_NUMBERS:
+            printNumbers(AS_NUMBERS(value));
+            break;
+        case OBJ_REGEX:
+            WRITE_LITERAL("<regex>");
+            break;
+        case OBJ_ROPE:
+        case OBJ_STRING: {
+            ObjString* string = AS_STRING(value);
+            WRITE_LITERAL("'");
+            writeOutput(string->chars, string->length);
+            WRITE_LITERAL("'");
+            break;
+        }
+        case OBJ_SHAPE:
+            WRITE_LITERAL("shape");
             break;
         case OBJ_UPVALUE:
-            printf("upvalue");
+            WRITE_LITERAL("upvalue");
             break;
         case OBJ_LIST:
             printList(AS_LIST(value));
@@ -229,5 +855,8 @@ void printObject(Value value) {
         case OBJ_MAP:
             printMap(AS_MAP(value));
             break;
+        case OBJ_SET:
+            printSet(AS_SET(value));
+            break;
     }
 }
@@ -3,42 +3,84 @@
 
 #include "common.h"
 #include "chunk.h"
+#include "reader.h"
+#include "regex.h"
 #include "table.h"
 #include "value.h"
 
 #define OBJ_TYPE(value)         (AS_OBJ(value)->type)
 
+#define IS_BUILDER(value)       isObjType(value, OBJ_BUILDER)
+#define IS_BYTES(value)         isObjType(value, OBJ_BYTES)
 #define IS_CLOSURE(value)       isObjType(value, OBJ_CLOSURE)
+#define IS_FILE(value)          isObjType(value, OBJ_FILE)
 #define IS_FUNCTION(value)      isObjType(value, OBJ_FUNCTION)
+#define IS_LINES(value)         isObjType(value, OBJ_LINES)
 #define IS_LIST(value)          isObjType(value, OBJ_LIST)
 #define IS_MAP(value)           isObjType(value, OBJ_MAP)
+#define IS_MAPPED(value)        isObjType(value, OBJ_MAPPED)
 #define IS_NATIVE(value)        isObjType(value, OBJ_NATIVE)
-#define IS_STRING(value)        isObjType(value, OBJ_STRING)
+#define IS_NUMBERS(value)       isObjType(value, OBJ_NUMBERS)
+#define IS_REGEX(value)         isObjType(value, OBJ_REGEX)
+#define IS_ROPE(value)          isObjType(value, OBJ_ROPE)
+#define IS_SET(value)           isObjType(value, OBJ_SET)
+#define IS_SHAPE(value)         isObjType(value, OBJ_SHAPE)
+#define IS_STRING(value)        isString(value)
 
+#define AS_BUILDER(value)       ((ObjBuilder*)AS_OBJ(value))
+#define AS_BYTES(value)         ((ObjBytes*)AS_OBJ(value))
 #define AS_CLOSURE(value)       ((ObjClosure*)AS_OBJ(value))
+#define AS_FILE(value)          ((ObjFile*)AS_OBJ(value))
 #define AS_FUNCTION(value)      ((ObjFunction*)AS_OBJ(value))
+#define AS_LINES(value)         ((ObjLines*)AS_OBJ(value))
 #define AS_LIST(value)          ((ObjList*)AS_OBJ(value))
 #define AS_NATIVE(value)        (((ObjNative*)AS_OBJ(value))->function)
+#define AS_NUMBERS(value)       ((ObjNumbers*)AS_OBJ(value))
+#define AS_REGEX(value)         ((ObjRegex*)AS_OBJ(value))
+#define AS_ROPE(value)          ((ObjRope*)AS_OBJ(value))
 #define AS_MAP(value)           ((ObjMap*)AS_OBJ(value))
-#define AS_STRING(value)        ((ObjString*)AS_OBJ(value))
-#define AS_CSTRING(value)       (((ObjString*)AS_OBJ(value))->chars)
+#define AS_MAPPED(value)        ((ObjMapped*)AS_OBJ(value))
+#define AS_SET(value)           ((ObjSet*)AS_OBJ(value))
+#define AS_SHAPE(value)         ((ObjShape*)AS_OBJ(value))
+#define AS_STRING(value)        asString(value)
+#define AS_CSTRING(value)       (asString(value)->chars)
 
 typedef enum {
+    OBJ_BUILDER,
+    OBJ_BYTES,
     OBJ_CLOSURE,
+    OBJ_FILE,
     OBJ_FUNCTION,
+    OBJ_LINES,
     OBJ_LIST,
     OBJ_MAP,
+    OBJ_MAPPED,
     OBJ_NATIVE,
+    OBJ_NUMBERS,
+    OBJ_REGEX,
+    OBJ_ROPE,
+    OBJ_SET,
+    OBJ_SHAPE,
     OBJ_STRING,
     OBJ_UPVALUE,
 } ObjType;
 
 static const char *OBJ_TYPE_STRINGS[] = {
+    "OBJ_BUILDER",
+    "OBJ_BYTES",
     "OBJ_CLOSURE",
+    "OBJ_FILE",
     "OBJ_FUNCTION",
+    "OBJ_LINES",
     "OBJ_LIST",
     "OBJ_MAP",
+    "OBJ_MAPPED",
     "OBJ_NATIVE",
+    "OBJ_NUMBERS",
+    "OBJ_REGEX",
+    "OBJ_ROPE",
+    "OBJ_SET",
+    "OBJ_SHAPE",
     "OBJ_STRING",
     "OBJ_UPVALUE"
     };
@@ -58,6 +100,9 @@ typedef struct {
     ObjString* name;
 } ObjFunction;
 
+// Size of the errMsg buffer natives write their error into
+#define NATIVE_ERROR_MAX 100
+
 typedef bool (*NativeFn) (int argCount, Value* args, Value* result, char errMsg[]);
 
 typedef struct {
@@ -68,13 +113,46 @@ typedef struct {
 // Note: hash is cached for strings because a) strings are immutable so the hash
 // will never change b) string lookups are a very frequent action in Clox and
 // we want it to be as quick as possible.
+// The characters are stored inline right after the header so a string is a
+// single allocation.
+// Strings made at runtime (concatenation, indexing) skip interning and only
+// compute their hash the first time something asks for it, so two equal
+// strings aren't always the same object. Compare them with valuesEqual.
+//
+// Scripts index and measure strings in UTF-8 codepoints. The first time that
+// matters the bytes are scanned once: ASCII strings index their bytes
+// directly, others get an offsets table built on the first index into them.
 struct sObjString {
     Obj obj;
-    int length;
-    char* chars;
+    int length;         // In bytes
     uint32_t hash;
+    bool hashed;        // hash is valid
+    bool interned;      // String is the copy in vm.strings
+    bool scanned;       // ascii and charCount are valid
+    bool ascii;
+    int charCount;      // Codepoints
+    int* offsets;       // Byte offset of every STRING_INDEX_STRIDE-th codepoint
+    char chars[];
 };
 
+// Indexing a non-ASCII string decodes at most this many codepoints
+#define STRING_INDEX_STRIDE 32
+
+// Concatenations at least this long make a rope instead of copying
+#define ROPE_MIN_LENGTH 128
+
+// A concatenation that hasn't been copied yet. Scripts see it as a string;
+// IS_STRING is true for it and AS_STRING flattens it into an ObjString the
+// first time, which allocates. Once flat the halves are dropped.
+typedef struct {
+    Obj obj;
+    int length;
+    int charCount;
+    Obj* left;          // ObjString or ObjRope
+    Obj* right;
+    ObjString* flat;
+} ObjRope;
+
 typedef struct sUpvalue {
     Obj obj;
     Value* location;
@@ -96,32 +174,178 @@ typedef struct {
     Value* items;
 } ObjList;
 
+// Hidden class shared by every map that had the same string keys inserted in
+// the same order. Such a map holds its nth key in items.entries[n - 1].
+// Transitions are weak; the GC prunes children that nothing else references.
+struct sObjShape {
+    Obj obj;
+    struct sObjShape* parent;
+    ObjString* key;     // Key added by the transition from parent
+    int count;          // Number of keys this shape describes
+    Table transitions;  // Key -> child shape
+};
+
+// Maps keep a shape until they get a non-string key, a deletion or too many
+// keys. From then on shape is NULL and they are plain dictionaries.
+//
+// Integer keys 0, 1, 2, ... can live in an array part indexed directly by the
+// key instead of in items. Only keys inserted before every key in items and in
+// ascending order go there, so walking the array part and then items still
+// visits keys in insertion order. Unused slots hold EMPTY_VAL.
 typedef struct {
     Obj obj;
+    ObjShape* shape;
+    int arrayCount;     // Present values in array
+    int arrayLength;    // One past the highest used slot of array
+    int arrayCapacity;
+    Value* array;
     Table items;
 } ObjMap;
 
+// Packed array of doubles for large numeric data such as CSV columns. It
+// indexes like a list of numbers but takes 8 bytes an item instead of a Value.
+typedef struct {
+    Obj obj;
+    int count;
+    int capacity;
+    double* items;
+} ObjNumbers;
+
+// Mutable buffer for building a string without making intermediate ones
+typedef struct {
+    Obj obj;
+    int length;
+    int capacity;
+    char* chars;
+} ObjBuilder;
+
+// Mutable raw bytes for binary data. Unlike strings they aren't interned or
+// hashed and they grow in place. Slicing makes a view that shares its owner's
+// bytes, so a write through either shows in both. A view keeps an offset
+// rather than a pointer, so its owner can still grow; the view itself can't.
+typedef struct sObjBytes {
+    Obj obj;
+    int length;
+    int capacity;
+    uint8_t* bytes;             // NULL for a view
+    struct sObjBytes* owner;    // What a view looks into, NULL otherwise
+    int offset;                 // Where in its owner a view starts
+} ObjBytes;
+
+// Read-only view of a memory-mapped file. Indexing and slicing it read the
+// file's bytes in place; the mapping is released when the view is collected.
+typedef struct {
+    Obj obj;
+    size_t length;
+    char* chars;
+} ObjMapped;
+
+// Compiled regular expression. The lazily built DFA states live with it, so
+// searching with the same one again reuses the work.
+typedef struct {
+    Obj obj;
+    Regex* regex;
+} ObjRegex;
+
+// A file opened for reading. The descriptor is closed by close() or, failing
+// that, when the file is collected.
+typedef struct {
+    Obj obj;
+    Reader reader;
+    bool closed;
+} ObjFile;
+
+// Iterator over the lines of a reader. Each next() reads just enough input
+// for one more line.
+typedef struct {
+    Obj obj;
+    Reader* reader;
+    Obj* source;        // File that owns reader, NULL for stdin
+} ObjLines;
+
+// Sets are tables whose values are always nil. Like maps they iterate in
+// insertion order.
+typedef struct {
+    Obj obj;
+    Table items;
+} ObjSet;
+
 ObjClosure* newClosure(ObjFunction* function);
 ObjFunction* newFunction();
 ObjNative* newNative(NativeFn function);
 ObjString* takeString(char* chars, int length);
 ObjString* copyString(const char* chars, int length);
+ObjString* newString(int length);
+ObjString* makeString(const char* chars, int length);
+uint32_t hashString(ObjString* string);
+ObjRope* newRope(Obj* left, Obj* right);
+ObjString* flattenRope(ObjRope* rope);
+void writeString(Value value, char* dest);
+bool stringsEqual(ObjString* a, ObjString* b);
+int stringCharLength(Value value);
+int stringCharOffset(ObjString* string, int index);
+int stringCharIndex(ObjString* string, int offset);
 Value indexFromString(ObjString* string, int index);
-bool isValidStringIndex(ObjString* list, int index);
+bool isValidStringIndex(ObjString* string, int index);
 ObjUpvalue* newUpvalue(Value* slot);
 ObjList* newList();
+void reserveList(ObjList* list, int capacity);
 void appendToList(ObjList* list, Value value);
 void storeToList(ObjList* list, int index, Value value);
 Value indexFromList(ObjList* list, int index);
 void deleteFromList(ObjList* list, int index);
 bool isValidListIndex(ObjList* list, int index);
 ObjMap* newMap();
+ObjShape* newShape(ObjShape* parent, ObjString* key);
+bool indexFromMap(ObjMap* map, Value key, Value* value);
+void storeToMap(ObjMap* map, Value key, Value value);
+bool deleteFromMap(ObjMap* map, Value key);
+int countMap(ObjMap* map);
+bool nextInMap(ObjMap* map, int* cursor, Value* key, Value* value);
+ObjBuilder* newBuilder();
+void appendToBuilder(ObjBuilder* builder, const char* chars, int length);
+ObjBytes* newBytes(int length);
+ObjBytes* takeBytes(uint8_t* bytes, int length, int capacity);
+ObjBytes* newBytesView(ObjBytes* bytes, int offset, int length);
+void resizeBytes(ObjBytes* bytes, int length);
+void appendToBytes(ObjBytes* bytes, const char* chars, size_t length);
+ObjFile* newFile(int fd);
+void closeFile(ObjFile* file);
+ObjLines* newLines(Reader* reader, Obj* source);
+ObjMapped* newMapped(char* chars, size_t length);
+ObjNumbers* newNumbers();
+void appendToNumbers(ObjNumbers* numbers, double number);
+ObjRegex* newRegex(Regex* regex);
+ObjSet* newSet();
+bool isInSet(ObjSet* set, Value item);
+bool setsEqual(ObjSet* a, ObjSet* b);
 void printObject(Value value);
 
 static inline bool isObjType(Value value, ObjType type) {
     return IS_OBJ(value) && AS_OBJ(value)->type == type;
 }
 
+static inline bool isString(Value value) {
+    return IS_OBJ(value) &&
+           (AS_OBJ(value)->type == OBJ_STRING || AS_OBJ(value)->type == OBJ_ROPE);
+}
+
+// Works for ropes too, without flattening them
+static inline int stringLength(Value value) {
+    if (AS_OBJ(value)->type == OBJ_ROPE) return AS_ROPE(value)->length;
+    return ((ObjString*)AS_OBJ(value))->length;
+}
+
+static inline ObjString* asString(Value value) {
+    if (AS_OBJ(value)->type == OBJ_ROPE) return flattenRope(AS_ROPE(value));
+    return (ObjString*)AS_OBJ(value);
+}
+
+static inline uint8_t* bytesData(ObjBytes* bytes) {
+    if (bytes->owner != NULL) return bytes->owner->bytes + bytes->offset;
+    return bytes->bytes;
+}
+
 static inline const char* stringFromObjType(ObjType type) {
     return OBJ_TYPE_STRINGS[type];
 }
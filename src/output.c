@@ -0,0 +1,47 @@
+#define _POSIX_C_SOURCE 200809L // For fileno and isatty
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "number.h"
+#include "output.h"
+#include "vm.h"
+
+void initOutput() {
+    vm.outputCount = 0;
+    vm.lineBuffered = isatty(fileno(stdout));
+}
+
+// Hands the buffer to stdio without forcing it out of the process.
+static void drainOutput() {
+    if (vm.outputCount > 0) {
+        fwrite(vm.output, 1, vm.outputCount, stdout);
+        vm.outputCount = 0;
+    }
+}
+
+void flushOutput() {
+    drainOutput();
+    fflush(stdout);
+}
+
+void writeOutput(const char* chars, int length) {
+    if (vm.outputCount + length > OUTPUT_BUFFER_SIZE) {
+        drainOutput();
+        if (length >= OUTPUT_BUFFER_SIZE) {
+            // Too big to be worth copying
+            fwrite(chars, 1, length, stdout);
+            if (vm.lineBuffered) fflush(stdout);
+            return;
+        }
+    }
+    memcpy(vm.output + vm.outputCount, chars, length);
+    vm.outputCount += length;
+    if (vm.lineBuffered && memchr(chars, '\n', length) != NULL) flushOutput();
+}
+
+void writeNumber(double number) {
+    if (vm.outputCount + NUMBER_BUFFER_SIZE > OUTPUT_BUFFER_SIZE) drainOutput();
+    vm.outputCount += formatNumber(number, vm.output + vm.outputCount);
+}
@@ -0,0 +1,18 @@
+#ifndef nqq_output_h
+#define nqq_output_h
+
+#include "common.h"
+
+// Script output collects in a buffer owned by the VM and reaches stdout in
+// large writes. When stdout is a terminal the buffer is also flushed at the
+// end of every line so output shows up as it is printed.
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+#define WRITE_LITERAL(text) writeOutput(text, sizeof(text) - 1)
+
+void initOutput();
+void writeOutput(const char* chars, int length);
+void writeNumber(double number);
+void flushOutput();
+
+#endif
@@ -0,0 +1,127 @@
+#define _POSIX_C_SOURCE 200809L // For read and fstat
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memory.h"
+#include "object.h"
+#include "reader.h"
+#include "search.h"
+#include "vm.h"
+
+void initReader(Reader* reader, int fd) {
+    reader->fd = fd;
+    reader->buffer = NULL;
+    reader->capacity = 0;
+    reader->start = 0;
+    reader->end = 0;
+    reader->scanned = 0;
+    reader->eof = false;
+}
+
+void freeReader(Reader* reader) {
+    FREE_ARRAY(char, reader->buffer, reader->capacity);
+    initReader(reader, reader->fd);
+}
+
+// Reads up to length bytes into chars, retrying if interrupted. Returns 0 at
+// the end of input and treats errors the same way.
+static int readBytes(int fd, char* chars, int length) {
+    for (;;) {
+        ssize_t count = read(fd, chars, length);
+        if (count >= 0) return (int)count;
+        if (errno != EINTR) return 0;
+    }
+}
+
+// Reads another block after the unread bytes, making room first. Returns
+// false once the input is exhausted.
+bool fillReader(Reader* reader) {
+    if (reader->eof) return false;
+
+    if (reader->start > 0) {
+        // Move what's left to the front
+        int unread = reader->end - reader->start;
+        memmove(reader->buffer, reader->buffer + reader->start, unread);
+        reader->start = 0;
+        reader->end = unread;
+    }
+    if (reader->end == reader->capacity) {
+        int oldCapacity = reader->capacity;
+        reader->capacity = oldCapacity < READER_BLOCK_SIZE ? READER_BLOCK_SIZE : oldCapacity * 2;
+        reader->buffer = GROW_ARRAY(reader->buffer, char, oldCapacity, reader->capacity);
+    }
+
+    int count = readBytes(reader->fd, reader->buffer + reader->end,
+                          reader->capacity - reader->end);
+    if (count == 0) {
+        reader->eof = true;
+        return false;
+    }
+    reader->end += count;
+    return true;
+}
+
+// Returns the next line without its newline, or NULL at the end of input. The
+// characters stay valid until the reader is next used.
+const char* readLine(Reader* reader, int* length) {
+    for (;;) {
+        int newline = findByte(reader->buffer, reader->end,
+                               reader->start + reader->scanned, '\n');
+        if (newline >= 0) {
+            const char* line = reader->buffer + reader->start;
+            *length = newline - reader->start;
+            reader->start = newline + 1;
+            reader->scanned = 0;
+            return line;
+        }
+        reader->scanned = reader->end - reader->start;
+
+        if (!fillReader(reader)) {
+            if (reader->start == reader->end) return NULL;
+            // Last line without a newline
+            const char* line = reader->buffer + reader->start;
+            *length = reader->end - reader->start;
+            reader->start = reader->end;
+            reader->scanned = 0;
+            return line;
+        }
+    }
+}
+
+// Returns everything left as one string. A regular file is read straight into
+// the string; anything else is collected in the buffer first.
+ObjString* readRest(Reader* reader) {
+    int unread = reader->end - reader->start;
+    struct stat info;
+    off_t position;
+    if (!reader->eof && fstat(reader->fd, &info) == 0 && S_ISREG(info.st_mode) &&
+        (position = lseek(reader->fd, 0, SEEK_CUR)) >= 0 && info.st_size >= position &&
+        info.st_size - position <= INT32_MAX - unread) {
+        int remaining = (int)(info.st_size - position);
+        ObjString* string = newString(unread + remaining);
+        memcpy(string->chars, reader->buffer + reader->start, unread);
+        int length = unread;
+        while (length < string->length) {
+            int count = readBytes(reader->fd, string->chars + length, string->length - length);
+            if (count == 0) break;
+            length += count;
+        }
+        reader->start = reader->end = reader->scanned = 0;
+        if (length == string->length) return string;
+        // The file shrank while it was read
+        push(OBJ_VAL(string));
+        ObjString* shorter = makeString(string->chars, length);
+        pop();
+        return shorter;
+    }
+
+    while (fillReader(reader)) {}
+    ObjString* string = makeString(reader->buffer + reader->start, reader->end - reader->start);
+    // Don't hold on to a buffer the size of the whole input
+    freeReader(reader);
+    reader->eof = true;
+    return string;
+}
@@ -0,0 +1,29 @@
+#ifndef nqq_reader_h
+#define nqq_reader_h
+
+#include "common.h"
+#include "value.h"
+
+// Buffered reading from a file descriptor. Input is read in large blocks and
+// lines are found with the vectorized byte search, so only the strings handed
+// to scripts are allocated. The unread tail slides to the front before each
+// read and a line longer than the buffer grows it.
+#define READER_BLOCK_SIZE (64 * 1024)
+
+typedef struct {
+    int fd;
+    char* buffer;       // Allocated on the first read
+    int capacity;
+    int start;          // First byte not handed out yet
+    int end;            // One past the last byte read
+    int scanned;        // Bytes after start known to hold no newline
+    bool eof;
+} Reader;
+
+void initReader(Reader* reader, int fd);
+void freeReader(Reader* reader);
+bool fillReader(Reader* reader);
+const char* readLine(Reader* reader, int* length);
+ObjString* readRest(Reader* reader);
+
+#endif
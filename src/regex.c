@@ -0,0 +1,1394 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "memory.h"
+#include "object.h"
+#include "regex.h"
+#include "search.h"
+
+// Patterns compiling to more instructions than this are rejected
+#define REGEX_MAX_PROGRAM 20000
+#define REGEX_MAX_REPEAT 1000
+#define REGEX_MAX_NESTING 256
+// Largest instructions times bytes the backtracker takes on, one bit each
+#define BACKTRACK_MAX_BITS (256 * 1024)
+// Bytes of states each lazy DFA may cache. A search that needs more finishes
+// on the Pike VM and the cache is dropped before the next one.
+#define DFA_MAX_MEMORY (4 * 1024 * 1024)
+
+typedef enum {
+    RE_BYTE,                // Consume byte x
+    RE_CLASS,               // Consume a byte in classes[x]
+    RE_SPLIT,               // Continue at x, and failing that at y
+    RE_JUMP,                // Continue at x
+    RE_SAVE,                // Record the position in capture slot x
+    RE_TEXT_START,
+    RE_TEXT_END,
+    RE_WORD_BOUNDARY,
+    RE_NOT_WORD_BOUNDARY,
+    RE_MATCH,
+} RegexOp;
+
+typedef struct {
+    uint8_t op;
+    int x;
+    int y;
+} Inst;
+
+typedef struct {
+    Inst* code;
+    int count;
+    int capacity;
+} Program;
+
+typedef struct {
+    uint64_t bits[4];
+} ByteSet;
+
+typedef struct sDfaState DfaState;
+
+// A DFA state is the list of NFA instructions threads are waiting at, in
+// priority order. Only instructions that consume a byte, MATCH and $ are
+// kept; the rest are followed when the list is built.
+struct sDfaState {
+    int* pcs;
+    int count;
+    uint32_t hash;
+    bool match;             // Holds MATCH
+    int8_t endMatch;        // Matches if the text ends here, -1 until known
+    DfaState* next[256];    // Filled in as bytes are seen
+};
+
+typedef struct {
+    Program* program;
+    bool longest;           // Look past a match for a longer one
+    DfaState** states;
+    int count;
+    int capacity;
+    DfaState** table;       // Open addressing on the instruction lists
+    int tableCapacity;
+    size_t memory;
+    DfaState* starts[4];    // By anchored * 2 + at the start of the text
+    int* list;              // Scratch for building a state
+    int* stack;
+    int* visited;
+    int generation;
+} Dfa;
+
+// Work for the Pike VM and backtracker: a pc to visit at position value, or
+// with slot set, a capture slot to restore to value
+typedef struct {
+    int pc;
+    int slot;
+    int value;
+} Job;
+
+struct sRegex {
+    Program forward;        // Loop for unanchored searches, then the pattern
+    Program reverse;        // The pattern backwards, for finding match starts
+    int anchoredStart;      // First instruction of forward after the loop
+    ByteSet* classes;
+    int classCount;
+    int classCapacity;
+    int groupCount;
+    char* prefix;           // Bytes every match starts with
+    int prefixLength;
+    bool literal;           // The pattern is just the prefix
+    bool useDfa;
+    Dfa forwardDfa;
+    Dfa reverseDfa;
+    // Pike VM scratch, allocated on first use
+    int* threadPcs[2];
+    int* threadCaps[2];
+    int* pikeVisited;
+    Job* pikeStack;
+    int* work;
+    int pikeGeneration;
+    // Backtracker scratch, allocated on first use
+    uint32_t* backtrackVisited;
+    Job* jobs;
+    int jobCapacity;
+};
+
+// Parsing builds a tree first so the program can be emitted both ways round.
+
+typedef enum {
+    NODE_EMPTY,
+    NODE_BYTE,
+    NODE_CLASS,
+    NODE_CONCAT,
+    NODE_ALTERNATE,
+    NODE_REPEAT,
+    NODE_GROUP,
+    NODE_ASSERT,
+} NodeType;
+
+typedef struct {
+    NodeType type;
+    int value;      // Byte, class, group number (-1 if not capturing) or op
+    int min;
+    int max;        // -1 for no limit
+    bool greedy;
+    int child;      // First child
+    int last;       // Last child
+    int next;       // Next sibling
+} Node;
+
+typedef struct {
+    const char* pattern;
+    int length;
+    int current;
+    Node* nodes;
+    int count;
+    int capacity;
+    Regex* regex;
+    int depth;
+    bool wordBoundary;
+    const char* error;
+    int errorPosition;
+} Parser;
+
+static int parseError(Parser* parser, const char* message) {
+    if (parser->error == NULL) {
+        parser->error = message;
+        parser->errorPosition = parser->current;
+    }
+    return -1;
+}
+
+static int addNode(Parser* parser, NodeType type, int value) {
+    if (parser->capacity < parser->count + 1) {
+        int oldCapacity = parser->capacity;
+        parser->capacity = GROW_CAPACITY(oldCapacity);
+        parser->nodes = GROW_ARRAY(parser->nodes, Node, oldCapacity, parser->capacity);
+    }
+    Node* node = &parser->nodes[parser->count];
+    node->type = type;
+    node->value = value;
+    node->min = 0;
+    node->max = 0;
+    node->greedy = true;
+    node->child = -1;
+    node->last = -1;
+    node->next = -1;
+    return parser->count++;
+}
+
+static void addChild(Parser* parser, int parent, int child) {
+    Node* node = &parser->nodes[parent];
+    if (node->child == -1) {
+        node->child = child;
+    } else {
+        parser->nodes[node->last].next = child;
+    }
+    node->last = child;
+}
+
+static void setRange(ByteSet* set, int low, int high) {
+    for (int byte = low; byte <= high; byte++) {
+        set->bits[byte >> 6] |= 1ULL << (byte & 63);
+    }
+}
+
+static bool hasByte(const ByteSet* set, uint8_t byte) {
+    return (set->bits[byte >> 6] >> (byte & 63)) & 1;
+}
+
+static int addClass(Parser* parser, const ByteSet* set) {
+    Regex* regex = parser->regex;
+    for (int i = 0; i < regex->classCount; i++) {
+        if (memcmp(&regex->classes[i], set, sizeof(ByteSet)) == 0) return i;
+    }
+    if (regex->classCapacity < regex->classCount + 1) {
+        int oldCapacity = regex->classCapacity;
+        regex->classCapacity = GROW_CAPACITY(oldCapacity);
+        regex->classes = GROW_ARRAY(regex->classes, ByteSet, oldCapacity, regex->classCapacity);
+    }
+    regex->classes[regex->classCount] = *set;
+    return regex->classCount++;
+}
+
+static int classNode(Parser* parser, int low, int high) {
+    ByteSet set = {{0, 0, 0, 0}};
+    setRange(&set, low, high);
+    return addNode(parser, NODE_CLASS, addClass(parser, &set));
+}
+
+// Matches any character outside ASCII as a whole UTF-8 sequence, and bytes
+// that can't start a sequence on their own.
+static int nonAsciiNode(Parser* parser) {
+    static const int leads[][2] = {{0xC0, 0xDF}, {0xE0, 0xEF}, {0xF0, 0xF7}};
+    int alternate = addNode(parser, NODE_ALTERNATE, 0);
+    for (int i = 0; i < 3; i++) {
+        int sequence = addNode(parser, NODE_CONCAT, 0);
+        addChild(parser, sequence, classNode(parser, leads[i][0], leads[i][1]));
+        for (int j = 0; j <= i; j++) {
+            addChild(parser, sequence, classNode(parser, 0x80, 0xBF));
+        }
+        addChild(parser, alternate, sequence);
+    }
+    ByteSet stray = {{0, 0, 0, 0}};
+    setRange(&stray, 0x80, 0xBF);
+    setRange(&stray, 0xF8, 0xFF);
+    addChild(parser, alternate, addNode(parser, NODE_CLASS, addClass(parser, &stray)));
+    return alternate;
+}
+
+// Matches the ASCII bytes in set and, if nonAscii, any other character
+static int charactersNode(Parser* parser, const ByteSet* set, bool nonAscii) {
+    int ascii = addNode(parser, NODE_CLASS, addClass(parser, set));
+    if (!nonAscii) return ascii;
+    int alternate = addNode(parser, NODE_ALTERNATE, 0);
+    addChild(parser, alternate, ascii);
+    addChild(parser, alternate, nonAsciiNode(parser));
+    return alternate;
+}
+
+static void addShorthand(ByteSet* set, char kind, bool negated) {
+    ByteSet members = {{0, 0, 0, 0}};
+    switch (kind) {
+        case 'd':
+            setRange(&members, '0', '9');
+            break;
+        case 'w':
+            setRange(&members, '0', '9');
+            setRange(&members, 'A', 'Z');
+            setRange(&members, 'a', 'z');
+            setRange(&members, '_', '_');
+            break;
+        case 's':
+            setRange(&members, '\t', '\r');
+            setRange(&members, ' ', ' ');
+            break;
+    }
+    for (int byte = 0; byte < 0x80; byte++) {
+        if (hasByte(&members, byte) != negated) setRange(set, byte, byte);
+    }
+}
+
+static int utf8Length(uint8_t lead) {
+    if (lead >= 0xF0 && lead <= 0xF7) return 4;
+    if (lead >= 0xE0) return 3;
+    if (lead >= 0xC0) return 2;
+    return 1;
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// The byte an escape stands for, the escape's letter already consumed
+static int escapedByte(Parser* parser, char c) {
+    switch (c) {
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        case '0': return '\0';
+        case 'x': {
+            if (parser->current + 2 > parser->length) return parseError(parser, "found an invalid \\x escape");
+            int high = hexValue(parser->pattern[parser->current]);
+            int low = hexValue(parser->pattern[parser->current + 1]);
+            if (high < 0 || low < 0) return parseError(parser, "found an invalid \\x escape");
+            parser->current += 2;
+            return high * 16 + low;
+        }
+    }
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        parser->current--;
+        return parseError(parser, "found an unknown escape");
+    }
+    return (uint8_t)c;
+}
+
+// A literal character, as a concatenation of its bytes if it has several
+static int literalNode(Parser* parser) {
+    int length = utf8Length((uint8_t)parser->pattern[parser->current]);
+    if (parser->current + length > parser->length) length = 1;
+    if (length == 1) {
+        return addNode(parser, NODE_BYTE, (uint8_t)parser->pattern[parser->current++]);
+    }
+    int sequence = addNode(parser, NODE_CONCAT, 0);
+    for (int i = 0; i < length; i++) {
+        addChild(parser, sequence,
+                 addNode(parser, NODE_BYTE, (uint8_t)parser->pattern[parser->current++]));
+    }
+    return sequence;
+}
+
+static int parseClass(Parser* parser) {
+    bool negated = parser->current < parser->length && parser->pattern[parser->current] == '^';
+    if (negated) parser->current++;
+
+    ByteSet set = {{0, 0, 0, 0}};
+    bool nonAscii = false;
+    int sequences = -1;     // Non-ASCII members as alternatives
+    bool first = true;
+    for (;;) {
+        if (parser->current >= parser->length) return parseError(parser, "found an unterminated class");
+        char c = parser->pattern[parser->current];
+        if (c == ']' && !first) {
+            parser->current++;
+            break;
+        }
+        first = false;
+
+        int low;
+        if (c == '\\') {
+            parser->current++;
+            if (parser->current >= parser->length) return parseError(parser, "found an unterminated class");
+            char escape = parser->pattern[parser->current++];
+            if (escape == 'd' || escape == 'w' || escape == 's') {
+                addShorthand(&set, escape, false);
+                continue;
+            }
+            if (escape == 'D' || escape == 'W' || escape == 'S') {
+                addShorthand(&set, escape - 'A' + 'a', true);
+                nonAscii = true;
+                continue;
+            }
+            low = escape == 'b' ? '\b' : escapedByte(parser, escape);
+            if (low < 0) return -1;
+        } else if ((uint8_t)c >= 0x80) {
+            if (negated) return parseError(parser, "found a non-ASCII character in a negated class");
+            if (sequences == -1) sequences = addNode(parser, NODE_ALTERNATE, 0);
+            addChild(parser, sequences, literalNode(parser));
+            continue;
+        } else {
+            low = (uint8_t)c;
+            parser->current++;
+        }
+
+        if (parser->current + 1 < parser->length && parser->pattern[parser->current] == '-' &&
+            parser->pattern[parser->current + 1] != ']') {
+            parser->current++;
+            char h = parser->pattern[parser->current];
+            int high;
+            if (h == '\\') {
+                parser->current++;
+                if (parser->current >= parser->length) return parseError(parser, "found an unterminated class");
+                high = escapedByte(parser, parser->pattern[parser->current++]);
+                if (high < 0) return -1;
+            } else if ((uint8_t)h >= 0x80) {
+                return parseError(parser, "found a non-ASCII range");
+            } else {
+                high = (uint8_t)h;
+                parser->current++;
+            }
+            if (high < low) return parseError(parser, "found a backwards range");
+            setRange(&set, low, high);
+        } else {
+            setRange(&set, low, low);
+        }
+    }
+
+    if (negated) {
+        ByteSet complement = {{0, 0, 0, 0}};
+        for (int byte = 0; byte < 0x80; byte++) {
+            if (!hasByte(&set, byte)) setRange(&complement, byte, byte);
+        }
+        set = complement;
+        nonAscii = !nonAscii;
+    }
+    int node = charactersNode(parser, &set, nonAscii);
+    if (sequences == -1) return node;
+    addChild(parser, sequences, node);
+    return sequences;
+}
+
+static int parseAlternation(Parser* parser);
+
+static int parseAtom(Parser* parser) {
+    char c = parser->pattern[parser->current];
+    switch (c) {
+        case '(': {
+            parser->current++;
+            if (++parser->depth > REGEX_MAX_NESTING) return parseError(parser, "found groups nested too deeply");
+            int group = -1;
+            if (parser->current < parser->length && parser->pattern[parser->current] == '?') {
+                if (parser->current + 1 >= parser->length || parser->pattern[parser->current + 1] != ':') {
+                    return parseError(parser, "found an unsupported group");
+                }
+                parser->current += 2;
+            } else {
+                group = ++parser->regex->groupCount;
+            }
+            int inner = parseAlternation(parser);
+            if (inner < 0) return -1;
+            if (parser->current >= parser->length) return parseError(parser, "expected ')'");
+            parser->current++;
+            parser->depth--;
+            int node = addNode(parser, NODE_GROUP, group);
+            addChild(parser, node, inner);
+            return node;
+        }
+        case '[':
+            parser->current++;
+            return parseClass(parser);
+        case '.': {
+            parser->current++;
+            ByteSet set = {{0, 0, 0, 0}};
+            setRange(&set, 0, 0x7F);
+            set.bits[0] &= ~(1ULL << '\n');
+            return charactersNode(parser, &set, true);
+        }
+        case '^':
+            parser->current++;
+            return addNode(parser, NODE_ASSERT, RE_TEXT_START);
+        case '$':
+            parser->current++;
+            return addNode(parser, NODE_ASSERT, RE_TEXT_END);
+        case '*':
+        case '+':
+        case '?':
+            return parseError(parser, "found nothing to repeat");
+        case '\\': {
+            parser->current++;
+            if (parser->current >= parser->length) return parseError(parser, "found a trailing backslash");
+            char escape = parser->pattern[parser->current++];
+            switch (escape) {
+                case 'd':
+                case 'w':
+                case 's': {
+                    ByteSet set = {{0, 0, 0, 0}};
+                    addShorthand(&set, escape, false);
+                    return charactersNode(parser, &set, false);
+                }
+                case 'D':
+                case 'W':
+                case 'S': {
+                    ByteSet set = {{0, 0, 0, 0}};
+                    addShorthand(&set, escape - 'A' + 'a', true);
+                    return charactersNode(parser, &set, true);
+                }
+                case 'b':
+                    parser->wordBoundary = true;
+                    return addNode(parser, NODE_ASSERT, RE_WORD_BOUNDARY);
+                case 'B':
+                    parser->wordBoundary = true;
+                    return addNode(parser, NODE_ASSERT, RE_NOT_WORD_BOUNDARY);
+            }
+            int byte = escapedByte(parser, escape);
+            if (byte < 0) return -1;
+            return addNode(parser, NODE_BYTE, byte);
+        }
+        default:
+            return literalNode(parser);
+    }
+}
+
+static int parseCount(Parser* parser) {
+    int count = 0;
+    int start = parser->current;
+    while (parser->current < parser->length && parser->pattern[parser->current] >= '0' &&
+           parser->pattern[parser->current] <= '9') {
+        if (count <= REGEX_MAX_REPEAT) count = count * 10 + parser->pattern[parser->current] - '0';
+        parser->current++;
+    }
+    return parser->current == start ? -1 : count;
+}
+
+// Parses {n}, {n,} or {n,m}. Returns 0 without consuming anything if the brace
+// doesn't start one, leaving it to be read as a literal.
+static int parseBounds(Parser* parser, int* min, int* max) {
+    int start = parser->current;
+    parser->current++;
+    *min = parseCount(parser);
+    *max = *min;
+    if (*min >= 0 && parser->current < parser->length && parser->pattern[parser->current] == ',') {
+        parser->current++;
+        *max = parseCount(parser);
+    }
+    if (*min < 0 || parser->current >= parser->length || parser->pattern[parser->current] != '}') {
+        parser->current = start;
+        return 0;
+    }
+    parser->current++;
+    if (*min > REGEX_MAX_REPEAT || *max > REGEX_MAX_REPEAT) {
+        parseError(parser, "found a repeat count over 1000");
+        return -1;
+    }
+    if (*max >= 0 && *max < *min) {
+        parseError(parser, "found a backwards repeat count");
+        return -1;
+    }
+    return 1;
+}
+
+static int parseRepeat(Parser* parser) {
+    int atom = parseAtom(parser);
+    if (atom < 0) return -1;
+
+    while (parser->current < parser->length) {
+        char c = parser->pattern[parser->current];
+        int min, max;
+        if (c == '*') {
+            min = 0;
+            max = -1;
+            parser->current++;
+        } else if (c == '+') {
+            min = 1;
+            max = -1;
+            parser->current++;
+        } else if (c == '?') {
+            min = 0;
+            max = 1;
+            parser->current++;
+        } else if (c == '{') {
+            int bounds = parseBounds(parser, &min, &max);
+            if (bounds < 0) return -1;
+            if (bounds == 0) break;
+        } else {
+            break;
+        }
+
+        int repeat = addNode(parser, NODE_REPEAT, 0);
+        parser->nodes[repeat].min = min;
+        parser->nodes[repeat].max = max;
+        if (parser->current < parser->length && parser->pattern[parser->current] == '?') {
+            parser->nodes[repeat].greedy = false;
+            parser->current++;
+        }
+        addChild(parser, repeat, atom);
+        atom = repeat;
+    }
+    return atom;
+}
+
+static int parseConcat(Parser* parser) {
+    int concat = addNode(parser, NODE_CONCAT, 0);
+    while (parser->current < parser->length && parser->pattern[parser->current] != '|' &&
+           parser->pattern[parser->current] != ')') {
+        int item = parseRepeat(parser);
+        if (item < 0) return -1;
+        if (parser->nodes[item].type == NODE_CONCAT) {
+            // Spread a multibyte literal's bytes out so they can be a prefix
+            int child = parser->nodes[item].child;
+            while (child != -1) {
+                int next = parser->nodes[child].next;
+                parser->nodes[child].next = -1;
+                addChild(parser, concat, child);
+                child = next;
+            }
+        } else {
+            addChild(parser, concat, item);
+        }
+    }
+    return concat;
+}
+
+static int parseAlternation(Parser* parser) {
+    int first = parseConcat(parser);
+    if (first < 0) return -1;
+    if (parser->current >= parser->length || parser->pattern[parser->current] != '|') return first;
+
+    int alternate = addNode(parser, NODE_ALTERNATE, 0);
+    addChild(parser, alternate, first);
+    while (parser->current < parser->length && parser->pattern[parser->current] == '|') {
+        parser->current++;
+        int branch = parseConcat(parser);
+        if (branch < 0) return -1;
+        addChild(parser, alternate, branch);
+    }
+    return alternate;
+}
+
+static int emit(Parser* parser, Program* program, RegexOp op, int x, int y) {
+    if (program->count >= REGEX_MAX_PROGRAM) parseError(parser, "found a pattern too big to compile");
+    if (program->capacity < program->count + 1) {
+        int oldCapacity = program->capacity;
+        program->capacity = GROW_CAPACITY(oldCapacity);
+        program->code = GROW_ARRAY(program->code, Inst, oldCapacity, program->capacity);
+    }
+    Inst* inst = &program->code[program->count];
+    inst->op = (uint8_t)op;
+    inst->x = x;
+    inst->y = y;
+    return program->count++;
+}
+
+// Whether the node can match without consuming a byte
+static bool nullable(Parser* parser, int index) {
+    Node* node = &parser->nodes[index];
+    switch (node->type) {
+        case NODE_BYTE:
+        case NODE_CLASS:
+            return false;
+        case NODE_CONCAT:
+            for (int child = node->child; child != -1; child = parser->nodes[child].next) {
+                if (!nullable(parser, child)) return false;
+            }
+            return true;
+        case NODE_ALTERNATE:
+            for (int child = node->child; child != -1; child = parser->nodes[child].next) {
+                if (nullable(parser, child)) return true;
+            }
+            return false;
+        case NODE_REPEAT:
+            return node->min == 0 || nullable(parser, node->child);
+        case NODE_GROUP:
+            return nullable(parser, node->child);
+        default:
+            return true;
+    }
+}
+
+static void compileNode(Parser* parser, Program* program, int index, bool reversed) {
+    if (parser->error != NULL) return;
+    Node* node = &parser->nodes[index];
+    switch (node->type) {
+        case NODE_EMPTY:
+            break;
+        case NODE_BYTE:
+            emit(parser, program, RE_BYTE, node->value, 0);
+            break;
+        case NODE_CLASS:
+            emit(parser, program, RE_CLASS, node->value, 0);
+            break;
+        case NODE_ASSERT: {
+            RegexOp op = node->value;
+            if (reversed && op == RE_TEXT_START) {
+                op = RE_TEXT_END;
+            } else if (reversed && op == RE_TEXT_END) {
+                op = RE_TEXT_START;
+            }
+            emit(parser, program, op, 0, 0);
+            break;
+        }
+        case NODE_GROUP:
+            if (node->value >= 0 && !reversed) emit(parser, program, RE_SAVE, node->value * 2, 0);
+            compileNode(parser, program, node->child, reversed);
+            if (node->value >= 0 && !reversed) emit(parser, program, RE_SAVE, node->value * 2 + 1, 0);
+            break;
+        case NODE_CONCAT: {
+            if (!reversed) {
+                for (int child = node->child; child != -1; child = parser->nodes[child].next) {
+                    compileNode(parser, program, child, reversed);
+                }
+                break;
+            }
+            int count = 0;
+            for (int child = node->child; child != -1; child = parser->nodes[child].next) count++;
+            int* children = ALLOCATE(int, count);
+            int i = 0;
+            for (int child = node->child; child != -1; child = parser->nodes[child].next) {
+                children[i++] = child;
+            }
+            for (i = count - 1; i >= 0; i--) compileNode(parser, program, children[i], reversed);
+            FREE_ARRAY(int, children, count);
+            break;
+        }
+        case NODE_ALTERNATE: {
+            // Each branch but the last is tried by a split and jumps to the
+            // end after. The jumps are chained through x until patched.
+            int jumps = -1;
+            int child = node->child;
+            for (; parser->nodes[child].next != -1; child = parser->nodes[child].next) {
+                int split = emit(parser, program, RE_SPLIT, program->count + 1, 0);
+                compileNode(parser, program, child, reversed);
+                jumps = emit(parser, program, RE_JUMP, jumps, 0);
+                program->code[split].y = program->count;
+            }
+            compileNode(parser, program, child, reversed);
+            while (jumps != -1) {
+                int previous = program->code[jumps].x;
+                program->code[jumps].x = program->count;
+                jumps = previous;
+            }
+            break;
+        }
+        case NODE_REPEAT: {
+            int child = node->child;
+            bool greedy = node->greedy;
+            if (node->max == -1 && (node->min > 0 || nullable(parser, child))) {
+                // Loops back after each copy, with leaving second, so an empty
+                // pass over the child can't fall through to lower priority
+                // branches inside it. x* of a nullable x is (?:x+)?.
+                int skip = -1;
+                if (node->min == 0) skip = emit(parser, program, RE_SPLIT, 0, 0);
+                for (int i = 1; i < node->min; i++) compileNode(parser, program, child, reversed);
+                int loop = program->count;
+                compileNode(parser, program, child, reversed);
+                emit(parser, program, RE_SPLIT, greedy ? loop : program->count + 1,
+                     greedy ? program->count + 1 : loop);
+                if (skip != -1) {
+                    program->code[skip].x = greedy ? skip + 1 : program->count;
+                    program->code[skip].y = greedy ? program->count : skip + 1;
+                }
+                break;
+            }
+            for (int i = 0; i < node->min; i++) compileNode(parser, program, child, reversed);
+            if (node->max == -1) {
+                int loop = emit(parser, program, RE_SPLIT, 0, 0);
+                compileNode(parser, program, child, reversed);
+                emit(parser, program, RE_JUMP, loop, 0);
+                program->code[loop].x = greedy ? loop + 1 : program->count;
+                program->code[loop].y = greedy ? program->count : loop + 1;
+                break;
+            }
+            // Optional copies, each skipping to the end, chained through y
+            int splits = -1;
+            for (int i = node->min; i < node->max; i++) {
+                splits = emit(parser, program, RE_SPLIT, 0, splits);
+                compileNode(parser, program, child, reversed);
+            }
+            while (splits != -1) {
+                int previous = program->code[splits].y;
+                program->code[splits].x = greedy ? splits + 1 : program->count;
+                program->code[splits].y = greedy ? program->count : splits + 1;
+                splits = previous;
+            }
+            break;
+        }
+    }
+}
+
+static void initDfa(Dfa* dfa, Program* program, bool longest) {
+    dfa->program = program;
+    dfa->longest = longest;
+    dfa->states = NULL;
+    dfa->count = 0;
+    dfa->capacity = 0;
+    dfa->table = NULL;
+    dfa->tableCapacity = 0;
+    dfa->memory = 0;
+    for (int i = 0; i < 4; i++) dfa->starts[i] = NULL;
+    dfa->list = ALLOCATE(int, program->count);
+    dfa->stack = ALLOCATE(int, program->count * 2 + 1);
+    dfa->visited = ALLOCATE(int, program->count);
+    memset(dfa->visited, 0, sizeof(int) * program->count);
+    dfa->generation = 0;
+}
+
+static void clearDfa(Dfa* dfa) {
+    for (int i = 0; i < dfa->count; i++) {
+        FREE_ARRAY(int, dfa->states[i]->pcs, dfa->states[i]->count);
+        FREE(DfaState, dfa->states[i]);
+    }
+    dfa->count = 0;
+    for (int i = 0; i < dfa->tableCapacity; i++) dfa->table[i] = NULL;
+    for (int i = 0; i < 4; i++) dfa->starts[i] = NULL;
+    dfa->memory = 0;
+}
+
+static void freeDfa(Dfa* dfa) {
+    clearDfa(dfa);
+    FREE_ARRAY(DfaState*, dfa->states, dfa->capacity);
+    FREE_ARRAY(DfaState*, dfa->table, dfa->tableCapacity);
+    FREE_ARRAY(int, dfa->list, dfa->program->count);
+    FREE_ARRAY(int, dfa->stack, dfa->program->count * 2 + 1);
+    FREE_ARRAY(int, dfa->visited, dfa->program->count);
+}
+
+static void nextGeneration(int* visited, int count, int* generation) {
+    if (*generation == INT32_MAX) {
+        memset(visited, 0, sizeof(int) * count);
+        *generation = 0;
+    }
+    (*generation)++;
+}
+
+// Adds the instructions reachable from start without consuming a byte to the
+// scratch list, in priority order.
+static void addClosure(Dfa* dfa, int start, bool atStart, bool atEnd, int* count) {
+    Inst* code = dfa->program->code;
+    int top = 0;
+    dfa->stack[top++] = start;
+    while (top > 0) {
+        int pc = dfa->stack[--top];
+        if (dfa->visited[pc] == dfa->generation) continue;
+        dfa->visited[pc] = dfa->generation;
+        Inst* inst = &code[pc];
+        switch (inst->op) {
+            case RE_JUMP:
+                dfa->stack[top++] = inst->x;
+                break;
+            case RE_SPLIT:
+                dfa->stack[top++] = inst->y;
+                dfa->stack[top++] = inst->x;
+                break;
+            case RE_SAVE:
+                dfa->stack[top++] = pc + 1;
+                break;
+            case RE_TEXT_START:
+                if (atStart) dfa->stack[top++] = pc + 1;
+                break;
+            case RE_TEXT_END:
+                if (atEnd) {
+                    dfa->stack[top++] = pc + 1;
+                } else {
+                    dfa->list[(*count)++] = pc;
+                }
+                break;
+            default:
+                dfa->list[(*count)++] = pc;
+                break;
+        }
+    }
+}
+
+static uint32_t hashPcs(const int* pcs, int count) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < count; i++) {
+        hash ^= (uint32_t)pcs[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+static void insertState(Dfa* dfa, DfaState* state) {
+    uint32_t index = state->hash & (dfa->tableCapacity - 1);
+    while (dfa->table[index] != NULL) index = (index + 1) & (dfa->tableCapacity - 1);
+    dfa->table[index] = state;
+}
+
+// Returns the state for the scratch list, making it if it's new, or NULL if
+// the cache is full.
+static DfaState* findState(Dfa* dfa, int count) {
+    Inst* code = dfa->program->code;
+    bool match = false;
+    for (int i = 0; i < count; i++) {
+        if (code[dfa->list[i]].op == RE_MATCH) {
+            match = true;
+            // Threads after a match have lower priority and can't win
+            if (!dfa->longest) count = i + 1;
+            break;
+        }
+    }
+
+    uint32_t hash = hashPcs(dfa->list, count);
+    if (dfa->tableCapacity > 0) {
+        uint32_t index = hash & (dfa->tableCapacity - 1);
+        for (DfaState* state; (state = dfa->table[index]) != NULL;
+             index = (index + 1) & (dfa->tableCapacity - 1)) {
+            if (state->hash == hash && state->count == count &&
+                memcmp(state->pcs, dfa->list, sizeof(int) * count) == 0) {
+                return state;
+            }
+        }
+    }
+
+    size_t size = sizeof(DfaState) + sizeof(int) * count;
+    if (dfa->memory + size > DFA_MAX_MEMORY) return NULL;
+    dfa->memory += size;
+
+    DfaState* state = ALLOCATE(DfaState, 1);
+    state->pcs = ALLOCATE(int, count);
+    if (count > 0) memcpy(state->pcs, dfa->list, sizeof(int) * count);
+    state->count = count;
+    state->hash = hash;
+    state->match = match;
+    state->endMatch = -1;
+    memset(state->next, 0, sizeof(state->next));
+
+    if (dfa->capacity < dfa->count + 1) {
+        int oldCapacity = dfa->capacity;
+        dfa->capacity = GROW_CAPACITY(oldCapacity);
+        dfa->states = GROW_ARRAY(dfa->states, DfaState*, oldCapacity, dfa->capacity);
+    }
+    dfa->states[dfa->count++] = state;
+
+    if (dfa->count * 2 > dfa->tableCapacity) {
+        int oldCapacity = dfa->tableCapacity;
+        dfa->tableCapacity = oldCapacity < 64 ? 64 : oldCapacity * 2;
+        dfa->table = GROW_ARRAY(dfa->table, DfaState*, oldCapacity, dfa->tableCapacity);
+        for (int i = 0; i < dfa->tableCapacity; i++) dfa->table[i] = NULL;
+        for (int i = 0; i < dfa->count; i++) insertState(dfa, dfa->states[i]);
+    } else {
+        insertState(dfa, state);
+    }
+    return state;
+}
+
+static DfaState* startState(Dfa* dfa, int pc, bool anchored, bool atStart) {
+    int slot = anchored * 2 + atStart;
+    if (dfa->starts[slot] == NULL) {
+        nextGeneration(dfa->visited, dfa->program->count, &dfa->generation);
+        int count = 0;
+        addClosure(dfa, pc, atStart, false, &count);
+        dfa->starts[slot] = findState(dfa, count);
+    }
+    return dfa->starts[slot];
+}
+
+static DfaState* stepState(Regex* regex, Dfa* dfa, DfaState* state, uint8_t byte) {
+    Inst* code = dfa->program->code;
+    nextGeneration(dfa->visited, dfa->program->count, &dfa->generation);
+    int count = 0;
+    for (int i = 0; i < state->count; i++) {
+        Inst* inst = &code[state->pcs[i]];
+        if ((inst->op == RE_BYTE && inst->x == byte) ||
+            (inst->op == RE_CLASS && hasByte(&regex->classes[inst->x], byte))) {
+            addClosure(dfa, state->pcs[i] + 1, false, false, &count);
+        }
+    }
+    DfaState* next = findState(dfa, count);
+    state->next[byte] = next;
+    return next;
+}
+
+// Whether the text ending in this state matches. Text that's also at its
+// start is rare enough not to cache.
+static bool endMatches(Dfa* dfa, DfaState* state, bool atStart) {
+    if (state->endMatch >= 0 && !atStart) return state->endMatch;
+    Inst* code = dfa->program->code;
+    nextGeneration(dfa->visited, dfa->program->count, &dfa->generation);
+    int count = 0;
+    bool match = state->match;
+    for (int i = 0; i < state->count && !match; i++) {
+        if (code[state->pcs[i]].op == RE_TEXT_END) {
+            addClosure(dfa, state->pcs[i] + 1, atStart, true, &count);
+        }
+    }
+    for (int i = 0; i < count && !match; i++) {
+        if (code[dfa->list[i]].op == RE_MATCH) match = true;
+    }
+    if (!atStart) state->endMatch = match;
+    return match;
+}
+
+// Finds where the leftmost match ends. Returns 1 with its end in matchEnd, 0
+// if there's no match or -1 if the DFA ran out of room.
+static int searchForward(Regex* regex, const char* chars, int length, int start, bool anchored,
+                         int* matchEnd) {
+    Dfa* dfa = &regex->forwardDfa;
+    if (dfa->memory * 2 > DFA_MAX_MEMORY) clearDfa(dfa);
+
+    DfaState* state = startState(dfa, anchored ? regex->anchoredStart : 0, anchored, start == 0);
+    if (state == NULL) return -1;
+    // With nothing matched yet the search is in this state until the prefix
+    // turns up, so it skips straight there
+    DfaState* prefixState = !anchored && regex->prefixLength > 0 ? state : NULL;
+
+    int end = state->match ? start : -1;
+    int position = start;
+    while (position < length && state->count > 0) {
+        if (state == prefixState) {
+            position = regex->prefixLength == 1 ?
+                findByte(chars, length, position, regex->prefix[0]) :
+                findBytes(chars, length, position, regex->prefix, regex->prefixLength);
+            if (position < 0) return 0;
+        }
+        uint8_t byte = (uint8_t)chars[position];
+        DfaState* next = state->next[byte];
+        if (next == NULL && (next = stepState(regex, dfa, state, byte)) == NULL) return -1;
+        state = next;
+        position++;
+        if (state->match) end = position;
+    }
+    if (position == length && state->count > 0 && endMatches(dfa, state, length == 0)) {
+        end = length;
+    }
+
+    if (end < 0) return 0;
+    *matchEnd = end;
+    return 1;
+}
+
+// Finds where the leftmost match ending at end starts, which is as far back
+// as the reversed pattern can match. Returns 1 with it in matchStart or -1 if
+// the DFA ran out of room.
+static int searchBackward(Regex* regex, const char* chars, int length, int limit, int end,
+                          int* matchStart) {
+    Dfa* dfa = &regex->reverseDfa;
+    if (dfa->memory * 2 > DFA_MAX_MEMORY) clearDfa(dfa);
+
+    DfaState* state = startState(dfa, 0, true, end == length);
+    if (state == NULL) return -1;
+
+    int start = state->match ? end : -1;
+    int position = end;
+    while (position > limit && state->count > 0) {
+        uint8_t byte = (uint8_t)chars[position - 1];
+        DfaState* next = state->next[byte];
+        if (next == NULL && (next = stepState(regex, dfa, state, byte)) == NULL) return -1;
+        state = next;
+        position--;
+        if (state->match) start = position;
+    }
+    if (position == 0 && state->count > 0 && endMatches(dfa, state, end == length)) {
+        start = 0;
+    }
+
+    if (start < 0) return -1;
+    *matchStart = start;
+    return 1;
+}
+
+static bool isWordByte(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool atWordBoundary(const char* chars, int length, int position) {
+    bool before = position > 0 && isWordByte(chars[position - 1]);
+    bool after = position < length && isWordByte(chars[position]);
+    return before != after;
+}
+
+// Adds a thread at pc, with the captures it carries, to a Pike VM list after
+// following everything that doesn't consume a byte.
+static void addThread(Regex* regex, int list, int* count, int start, const int* caps,
+                      const char* chars, int length, int position) {
+    Inst* code = regex->forward.code;
+    int capCount = 2 * (regex->groupCount + 1);
+    int* work = regex->work;
+    Job* stack = regex->pikeStack;
+    memcpy(work, caps, sizeof(int) * capCount);
+
+    int top = 0;
+    stack[top++] = (Job){start, -1, 0};
+    while (top > 0) {
+        Job entry = stack[--top];
+        if (entry.slot >= 0) {
+            work[entry.slot] = entry.value;
+            continue;
+        }
+        int pc = entry.pc;
+        if (regex->pikeVisited[pc] == regex->pikeGeneration) continue;
+        regex->pikeVisited[pc] = regex->pikeGeneration;
+
+        Inst* inst = &code[pc];
+        switch (inst->op) {
+            case RE_JUMP:
+                stack[top++] = (Job){inst->x, -1, 0};
+                break;
+            case RE_SPLIT:
+                stack[top++] = (Job){inst->y, -1, 0};
+                stack[top++] = (Job){inst->x, -1, 0};
+                break;
+            case RE_SAVE:
+                // Put the old value back once everything after is added
+                stack[top++] = (Job){0, inst->x, work[inst->x]};
+                work[inst->x] = position;
+                stack[top++] = (Job){pc + 1, -1, 0};
+                break;
+            case RE_TEXT_START:
+                if (position == 0) stack[top++] = (Job){pc + 1, -1, 0};
+                break;
+            case RE_TEXT_END:
+                if (position == length) stack[top++] = (Job){pc + 1, -1, 0};
+                break;
+            case RE_WORD_BOUNDARY:
+            case RE_NOT_WORD_BOUNDARY:
+                if (atWordBoundary(chars, length, position) == (inst->op == RE_WORD_BOUNDARY)) {
+                    stack[top++] = (Job){pc + 1, -1, 0};
+                }
+                break;
+            default:
+                regex->threadPcs[list][*count] = pc;
+                memcpy(regex->threadCaps[list] + *count * capCount, work, sizeof(int) * capCount);
+                (*count)++;
+                break;
+        }
+    }
+}
+
+// Runs every thread in lockstep over the text, so the work is bounded by the
+// text length times the program size whatever the pattern.
+static bool searchPike(Regex* regex, const char* chars, int length, int start, bool anchored,
+                       int* captures) {
+    int programCount = regex->forward.count;
+    int capCount = 2 * (regex->groupCount + 1);
+    if (regex->work == NULL) {
+        for (int i = 0; i < 2; i++) {
+            regex->threadPcs[i] = ALLOCATE(int, programCount);
+            regex->threadCaps[i] = ALLOCATE(int, programCount * capCount);
+        }
+        regex->pikeVisited = ALLOCATE(int, programCount);
+        memset(regex->pikeVisited, 0, sizeof(int) * programCount);
+        regex->pikeStack = ALLOCATE(Job, programCount * 2 + 1);
+        regex->work = ALLOCATE(int, capCount);
+        regex->pikeGeneration = 0;
+    }
+
+    for (int i = 0; i < capCount; i++) captures[i] = -1;
+    int current = 0;
+    int counts[2] = {0, 0};
+    nextGeneration(regex->pikeVisited, programCount, &regex->pikeGeneration);
+    addThread(regex, current, &counts[current], anchored ? regex->anchoredStart : 0, captures,
+              chars, length, start);
+
+    Inst* code = regex->forward.code;
+    bool matched = false;
+    for (int position = start; counts[current] > 0; position++) {
+        int next = 1 - current;
+        counts[next] = 0;
+        nextGeneration(regex->pikeVisited, programCount, &regex->pikeGeneration);
+        for (int i = 0; i < counts[current]; i++) {
+            Inst* inst = &code[regex->threadPcs[current][i]];
+            int* caps = regex->threadCaps[current] + i * capCount;
+            if (inst->op == RE_MATCH) {
+                // Lower priority threads are dropped
+                memcpy(captures, caps, sizeof(int) * capCount);
+                matched = true;
+                break;
+            }
+            if (position < length &&
+                ((inst->op == RE_BYTE && inst->x == (uint8_t)chars[position]) ||
+                 (inst->op == RE_CLASS && hasByte(&regex->classes[inst->x], chars[position])))) {
+                addThread(regex, next, &counts[next], regex->threadPcs[current][i] + 1, caps,
+                          chars, length, position + 1);
+            }
+        }
+        current = next;
+        if (position >= length) break;
+    }
+    return matched;
+}
+
+// Tries threads depth first in priority order, so the first MATCH reached is
+// the leftmost-first match. Each pc is tried at each position at most once,
+// which keeps it linear, so it only takes on small programs and spans.
+static bool canBacktrack(Regex* regex, int start, int end) {
+    return (int64_t)regex->forward.count * (end - start + 1) <= BACKTRACK_MAX_BITS;
+}
+
+static void pushJob(Regex* regex, int* count, int pc, int slot, int value) {
+    if (regex->jobCapacity < *count + 1) {
+        int oldCapacity = regex->jobCapacity;
+        regex->jobCapacity = GROW_CAPACITY(oldCapacity);
+        regex->jobs = GROW_ARRAY(regex->jobs, Job, oldCapacity, regex->jobCapacity);
+    }
+    regex->jobs[(*count)++] = (Job){pc, slot, value};
+}
+
+// Positions are kept to at most end. Threads that would go further can't be
+// the match when the DFA found it ends at end.
+static bool searchBacktrack(Regex* regex, const char* chars, int length, int start, int end,
+                            bool anchored, int* captures) {
+    if (regex->backtrackVisited == NULL) {
+        regex->backtrackVisited = ALLOCATE(uint32_t, BACKTRACK_MAX_BITS / 32);
+    }
+    int span = end - start + 1;
+    uint32_t* visited = regex->backtrackVisited;
+    memset(visited, 0, sizeof(uint32_t) * ((regex->forward.count * span + 31) / 32));
+    int capCount = 2 * (regex->groupCount + 1);
+    for (int i = 0; i < capCount; i++) captures[i] = -1;
+
+    Inst* code = regex->forward.code;
+    int count = 0;
+    pushJob(regex, &count, anchored ? regex->anchoredStart : 0, -1, start);
+    while (count > 0) {
+        Job job = regex->jobs[--count];
+        if (job.slot >= 0) {
+            captures[job.slot] = job.value;
+            continue;
+        }
+        int pc = job.pc;
+        int position = job.value;
+        for (;;) {
+            int bit = pc * span + position - start;
+            if (visited[bit / 32] & (1u << (bit % 32))) break;
+            visited[bit / 32] |= 1u << (bit % 32);
+
+            Inst* inst = &code[pc];
+            bool next = false;
+            switch (inst->op) {
+                case RE_BYTE:
+                    next = position < end && (uint8_t)chars[position] == inst->x;
+                    position += next;
+                    break;
+                case RE_CLASS:
+                    next = position < end && hasByte(&regex->classes[inst->x], chars[position]);
+                    position += next;
+                    break;
+                case RE_SPLIT:
+                    pushJob(regex, &count, inst->y, -1, position);
+                    pc = inst->x;
+                    continue;
+                case RE_JUMP:
+                    pc = inst->x;
+                    continue;
+                case RE_SAVE:
+                    pushJob(regex, &count, 0, inst->x, captures[inst->x]);
+                    captures[inst->x] = position;
+                    next = true;
+                    break;
+                case RE_TEXT_START:
+                    next = position == 0;
+                    break;
+                case RE_TEXT_END:
+                    next = position == length;
+                    break;
+                case RE_WORD_BOUNDARY:
+                case RE_NOT_WORD_BOUNDARY:
+                    next = atWordBoundary(chars, length, position) == (inst->op == RE_WORD_BOUNDARY);
+                    break;
+                case RE_MATCH:
+                    return true;
+            }
+            if (!next) break;
+            pc++;
+        }
+    }
+    return false;
+}
+
+bool searchRegex(Regex* regex, const char* chars, int length, int start, bool anchored,
+                 int* captures, bool wantGroups) {
+    if (start > length) return false;
+
+    if (regex->literal) {
+        int found;
+        if (anchored) {
+            found = length - start >= regex->prefixLength &&
+                    memcmp(chars + start, regex->prefix, regex->prefixLength) == 0 ? start : -1;
+        } else if (regex->prefixLength == 1) {
+            found = findByte(chars, length, start, regex->prefix[0]);
+        } else {
+            found = findBytes(chars, length, start, regex->prefix, regex->prefixLength);
+        }
+        if (found < 0) return false;
+        captures[0] = found;
+        captures[1] = found + regex->prefixLength;
+        return true;
+    }
+
+    if (regex->useDfa) {
+        int end;
+        int found = searchForward(regex, chars, length, start, anchored, &end);
+        if (found == 0) return false;
+        int matchStart = start;
+        if (found == 1 && !anchored) {
+            found = searchBackward(regex, chars, length, start, end, &matchStart);
+        }
+        if (found == 1) {
+            if (!wantGroups || regex->groupCount == 0) {
+                captures[0] = matchStart;
+                captures[1] = end;
+                return true;
+            }
+            if (canBacktrack(regex, matchStart, end)) {
+                return searchBacktrack(regex, chars, length, matchStart, end, true, captures);
+            }
+            return searchPike(regex, chars, length, matchStart, true, captures);
+        }
+    }
+    if (canBacktrack(regex, start, length)) {
+        return searchBacktrack(regex, chars, length, start, length, anchored, captures);
+    }
+    return searchPike(regex, chars, length, start, anchored, captures);
+}
+
+static void findPrefix(Parser* parser, int root) {
+    Regex* regex = parser->regex;
+    Node* node = &parser->nodes[root];
+    int count = 0;
+    bool onlyBytes = true;
+    if (node->type == NODE_BYTE) {
+        count = 1;
+    } else if (node->type == NODE_CONCAT) {
+        for (int child = node->child; child != -1; child = parser->nodes[child].next) {
+            if (parser->nodes[child].type != NODE_BYTE) {
+                onlyBytes = false;
+                break;
+            }
+            count++;
+        }
+    } else {
+        onlyBytes = false;
+    }
+    if (count == 0) return;
+
+    regex->prefix = ALLOCATE(char, count);
+    regex->prefixLength = count;
+    if (node->type == NODE_BYTE) {
+        regex->prefix[0] = (char)node->value;
+    } else {
+        int child = node->child;
+        for (int i = 0; i < count; i++, child = parser->nodes[child].next) {
+            regex->prefix[i] = (char)parser->nodes[child].value;
+        }
+    }
+    regex->literal = onlyBytes;
+}
+
+Regex* compileRegex(const char* pattern, int length, char* errMsg) {
+    Regex* regex = ALLOCATE(Regex, 1);
+    memset(regex, 0, sizeof(Regex));
+
+    Parser parser;
+    parser.pattern = pattern;
+    parser.length = length;
+    parser.current = 0;
+    parser.nodes = NULL;
+    parser.count = 0;
+    parser.capacity = 0;
+    parser.regex = regex;
+    parser.depth = 0;
+    parser.wordBoundary = false;
+    parser.error = NULL;
+    parser.errorPosition = 0;
+
+    int root = parseAlternation(&parser);
+    if (root >= 0 && parser.current < length) parseError(&parser, "found an unmatched ')'");
+
+    if (parser.error == NULL) {
+        // Unanchored searches start in a lowest priority loop over every byte
+        ByteSet all = {{~0ULL, ~0ULL, ~0ULL, ~0ULL}};
+        Program* forward = &regex->forward;
+        emit(&parser, forward, RE_SPLIT, 3, 1);
+        emit(&parser, forward, RE_CLASS, addClass(&parser, &all), 0);
+        emit(&parser, forward, RE_JUMP, 0, 0);
+        regex->anchoredStart = forward->count;
+        emit(&parser, forward, RE_SAVE, 0, 0);
+        compileNode(&parser, forward, root, false);
+        emit(&parser, forward, RE_SAVE, 1, 0);
+        emit(&parser, forward, RE_MATCH, 0, 0);
+
+        compileNode(&parser, &regex->reverse, root, true);
+        emit(&parser, &regex->reverse, RE_MATCH, 0, 0);
+    }
+
+    if (parser.error != NULL) {
+        snprintf(errMsg, NATIVE_ERROR_MAX, "regex %s at byte %d.",
+                 parser.error, parser.errorPosition);
+        FREE_ARRAY(Node, parser.nodes, parser.capacity);
+        freeRegex(regex);
+        return NULL;
+    }
+
+    findPrefix(&parser, root);
+    FREE_ARRAY(Node, parser.nodes, parser.capacity);
+    regex->useDfa = !parser.wordBoundary;
+    if (regex->useDfa) {
+        initDfa(&regex->forwardDfa, &regex->forward, false);
+        initDfa(&regex->reverseDfa, &regex->reverse, true);
+    }
+    return regex;
+}
+
+void freeRegex(Regex* regex) {
+    if (regex->useDfa) {
+        freeDfa(&regex->forwardDfa);
+        freeDfa(&regex->reverseDfa);
+    }
+    if (regex->work != NULL) {
+        int programCount = regex->forward.count;
+        int capCount = 2 * (regex->groupCount + 1);
+        for (int i = 0; i < 2; i++) {
+            FREE_ARRAY(int, regex->threadPcs[i], programCount);
+            FREE_ARRAY(int, regex->threadCaps[i], programCount * capCount);
+        }
+        FREE_ARRAY(int, regex->pikeVisited, programCount);
+        FREE_ARRAY(Job, regex->pikeStack, programCount * 2 + 1);
+        FREE_ARRAY(int, regex->work, capCount);
+    }
+    if (regex->backtrackVisited != NULL) {
+        FREE_ARRAY(uint32_t, regex->backtrackVisited, BACKTRACK_MAX_BITS / 32);
+    }
+    FREE_ARRAY(Job, regex->jobs, regex->jobCapacity);
+    FREE_ARRAY(Inst, regex->forward.code, regex->forward.capacity);
+    FREE_ARRAY(Inst, regex->reverse.code, regex->reverse.capacity);
+    FREE_ARRAY(ByteSet, regex->classes, regex->classCapacity);
+    FREE_ARRAY(char, regex->prefix, regex->prefixLength);
+    FREE(Regex, regex);
+}
+
+int regexGroupCount(Regex* regex) {
+    return regex->groupCount;
+}
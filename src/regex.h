@@ -0,0 +1,34 @@
+#ifndef nqq_regex_h
+#define nqq_regex_h
+
+#include "common.h"
+
+// Regular expressions compiled once into a byte-level NFA program, in the
+// style of RE2. A search runs a lazily built DFA forwards to find where the
+// leftmost match ends and another over the reversed program backwards from
+// there to find where it starts. Groups are then filled in over just the
+// match, by a backtracker bounded to visit each instruction at each position
+// once when that's small enough and the Pike VM otherwise. Every path is
+// linear in the text, so no pattern can backtrack catastrophically. Patterns
+// using \b or \B skip the DFAs.
+//
+// Syntax: literals, ., [...] and [^...] with ranges, \d \w \s and their
+// negations, ^ and $ for the ends of the text, \b and \B, groups and (?:...),
+// |, and * + ? {n} {n,} {n,m} with lazy forms ending in ?. . and negated
+// classes match whole UTF-8 characters; . doesn't match a newline.
+typedef struct sRegex Regex;
+
+// Returns NULL and describes the problem in errMsg, which needs
+// NATIVE_ERROR_MAX bytes, if the pattern is invalid.
+Regex* compileRegex(const char* pattern, int length, char* errMsg);
+void freeRegex(Regex* regex);
+int regexGroupCount(Regex* regex);
+
+// Finds the leftmost match starting at or after start, or exactly at start if
+// anchored. captures needs room for 2 * (regexGroupCount + 1) byte offsets:
+// the match's start and end followed by each group's, -1 for a group that
+// didn't take part. Groups are only filled in if wantGroups is set.
+bool searchRegex(Regex* regex, const char* chars, int length, int start, bool anchored,
+                 int* captures, bool wantGroups);
+
+#endif
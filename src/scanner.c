@@ -4,10 +4,15 @@
 #include "common.h"
 #include "scanner.h"
 
+#define MAX_INTERPOLATION_DEPTH 8
+
 typedef struct {
     const char* start;
     const char* current;
     int line;
+    // Unclosed '{' inside each open "${...}", innermost last
+    int braces[MAX_INTERPOLATION_DEPTH];
+    int interpolationDepth;
 } Scanner;
 
 Scanner scanner;
@@ -16,6 +21,7 @@ void initScanner(const char* source) {
     scanner.start = source;
     scanner.current = source;
     scanner.line = 1;
+    scanner.interpolationDepth = 0;
 }
 
 static bool isAlpha(char c) {
@@ -199,6 +205,9 @@ static Token basicString() {
     return makeToken(TOKEN_BASIC_STRING);
 }
 
+// Scans template string text up to the closing quote or the next "${". The
+// token starts at the opening quote, or at the '}' that ended the previous
+// interpolation.
 static Token templateString() {
     while (peek() != '"' && peek() != '\n' && !isAtEnd()) {
         if (peek() == '\n') {
@@ -208,8 +217,16 @@ static Token templateString() {
         } else if (peek() == '\\' && peekNext() == '\n') {
             advance();
             scanner.line++;
-        } else if (peek() == '\\' && peekNext() == '\\') {
+        } else if (peek() == '\\' && (peekNext() == '\\' || peekNext() == '$')) {
+            advance();
+        } else if (peek() == '$' && peekNext() == '{') {
+            if (scanner.interpolationDepth == MAX_INTERPOLATION_DEPTH) {
+                return errorToken("Interpolation nested too deeply.");
+            }
+            advance();
             advance();
+            scanner.braces[scanner.interpolationDepth++] = 0;
+            return makeToken(TOKEN_INTERPOLATION);
         }
         advance();
     }
@@ -249,8 +266,21 @@ Token scanToken() {
     switch (c) {
         case '(': return makeToken(TOKEN_LEFT_PAREN);
         case ')': return makeToken(TOKEN_RIGHT_PAREN);
-        case '{': return makeToken(TOKEN_LEFT_BRACE);
-        case '}': return makeToken(TOKEN_RIGHT_BRACE);
+        case '{':
+            if (scanner.interpolationDepth > 0) {
+                scanner.braces[scanner.interpolationDepth - 1]++;
+            }
+            return makeToken(TOKEN_LEFT_BRACE);
+        case '}':
+            if (scanner.interpolationDepth > 0) {
+                // This brace closes the interpolation, so the string goes on
+                if (scanner.braces[scanner.interpolationDepth - 1] == 0) {
+                    scanner.interpolationDepth--;
+                    return templateString();
+                }
+                scanner.braces[scanner.interpolationDepth - 1]--;
+            }
+            return makeToken(TOKEN_RIGHT_BRACE);
         case '[': return makeToken(TOKEN_LEFT_BRACKET);
         case ']': return makeToken(TOKEN_RIGHT_BRACKET);
         case ';': return makeToken(TOKEN_SEMICOLON);
@@ -308,5 +338,3 @@ Token scanToken() {
 
     return errorToken("Unexpected character.");
 }
-
-// TODO support string interpolation
\ No newline at end of file
@@ -20,7 +20,7 @@ typedef enum {
 
     // Literals.
     TOKEN_BASIC_STRING, TOKEN_IDENTIFIER, TOKEN_NUMBER,
-    TOKEN_TEMPLATE_STRING, TOKEN_RAW_STRING,
+    TOKEN_TEMPLATE_STRING, TOKEN_INTERPOLATION, TOKEN_RAW_STRING,
 
     // Keywords.
     TOKEN_AND, TOKEN_BREAK, TOKEN_CONTINUE,
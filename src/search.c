@@ -0,0 +1,87 @@
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "search.h"
+
+// Returns the index of the first c at or after start or -1.
+int findByte(const char* chars, int length, int start, char c) {
+    int i = start;
+#ifdef __SSE2__
+    __m128i target = _mm_set1_epi8(c);
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(chars + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, target));
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < length; i++) {
+        if (chars[i] == c) return i;
+    }
+    return -1;
+}
+
+// Returns the index of the first needle at or after start or -1. An empty
+// needle is found right at start.
+int findBytes(const char* chars, int length, int start, const char* needle, int needleLength) {
+    if (needleLength == 0) return start <= length ? start : -1;
+    if (needleLength == 1) return findByte(chars, length, start, needle[0]);
+
+    int last = length - needleLength; // Last position a match can start at
+    int i = start;
+#ifdef __SSE2__
+    // Only positions where both the first and last bytes match are compared
+    // in full, which skips nearly everything for typical text.
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i final = _mm_set1_epi8(needle[needleLength - 1]);
+    for (; i + 16 <= last + 1; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i*)(chars + i));
+        __m128i blockFinal = _mm_loadu_si128((const __m128i*)(chars + i + needleLength - 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first),
+                                                   _mm_cmpeq_epi8(blockFinal, final)));
+        while (mask != 0) {
+            int offset = __builtin_ctz(mask);
+            if (memcmp(chars + i + offset + 1, needle + 1, needleLength - 2) == 0) {
+                return i + offset;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i <= last; i++) {
+        if (chars[i] == needle[0] && memcmp(chars + i + 1, needle + 1, needleLength - 1) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns how many non-overlapping times a non-empty needle occurs.
+int countBytes(const char* chars, int length, const char* needle, int needleLength) {
+    int count = 0;
+    int i = findBytes(chars, length, 0, needle, needleLength);
+    while (i != -1) {
+        count++;
+        i = findBytes(chars, length, i + needleLength, needle, needleLength);
+    }
+    return count;
+}
+
+// Returns whether no byte has its high bit set.
+bool isAscii(const char* chars, int length) {
+    int i = 0;
+#ifdef __SSE2__
+    __m128i seen = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16) {
+        seen = _mm_or_si128(seen, _mm_loadu_si128((const __m128i*)(chars + i)));
+    }
+    if (_mm_movemask_epi8(seen) != 0) return false;
+#endif
+    unsigned char seenByte = 0;
+    for (; i < length; i++) {
+        seenByte |= (unsigned char)chars[i];
+    }
+    return seenByte < 0x80;
+}
@@ -0,0 +1,13 @@
+#ifndef nqq_search_h
+#define nqq_search_h
+
+#include "common.h"
+
+// Byte searches used by strings and the string natives. They scan 16 bytes at a time with
+// SSE2 when the compiler targets it and fall back to plain loops otherwise.
+int findByte(const char* chars, int length, int start, char c);
+int findBytes(const char* chars, int length, int start, const char* needle, int needleLength);
+int countBytes(const char* chars, int length, const char* needle, int needleLength);
+bool isAscii(const char* chars, int length);
+
+#endif
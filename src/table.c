@@ -8,14 +8,23 @@
 
 #define TABLE_MAX_LOAD 0.75 // TODO tune this value
 
+#define INDEX_EMPTY -1
+#define INDEX_TOMBSTONE -2
+
+// Only this many entries fit before the indices have to be rebuilt.
+#define ENTRY_CAPACITY(capacity) ((int)((capacity) * TABLE_MAX_LOAD))
+
 void initTable(Table* table) {
     table->count = 0;
+    table->entryCount = 0;
     table->capacity = 0;
+    table->indices = NULL;
     table->entries = NULL;
 }
 
 void freeTable(Table* table) {
-    FREE_ARRAY(Entry, table->entries, table->capacity);
+    FREE_ARRAY(int32_t, table->indices, table->capacity);
+    FREE_ARRAY(Entry, table->entries, ENTRY_CAPACITY(table->capacity));
     initTable(table);
 }
 
@@ -31,7 +40,9 @@ uint32_t hashBytes(uint8_t* key, int length) {
 }
 
 bool isHashable(Value value) {
-    if (IS_LIST(value) || IS_MAP(value)) {
+    if (IS_LIST(value) || IS_MAP(value) || IS_SET(value) || IS_BUILDER(value) ||
+        IS_BYTES(value) || IS_FILE(value) || IS_LINES(value) || IS_MAPPED(value) ||
+        IS_NUMBERS(value) || IS_REGEX(value)) {
         return false;
     }
     return true;
@@ -85,7 +96,13 @@ static uint32_t hashValue(Value value) {
         return 2;
     }
     case VAL_NUMBER: {
-        return (uint32_t)AS_NUMBER(value);
+        // Integers hash to themselves so consecutive keys spread out
+        // perfectly. Anything else hashes its bits instead of truncating.
+        double number = AS_NUMBER(value);
+        if (number >= INT32_MIN && number <= INT32_MAX && number == (int32_t)number) {
+            return (uint32_t)(int32_t)number;
+        }
+        return hashBytes((uint8_t*)&number, sizeof(double));
     }
     case VAL_OBJ: {
         return hashObject(AS_OBJ(value));
@@ -97,127 +114,186 @@ static uint32_t hashValue(Value value) {
     return 0;
 }
 
-static Entry* findEntry(Entry* entries, int capacity, Value key) {
-    uint32_t hash;
+static uint32_t hashKey(Value key) {
     if (IS_STRING(key)) {
-        hash = AS_STRING(key)->hash;
-    } else {
-        hash = hashValue(key);
+        return hashString(AS_STRING(key));
     }
-    uint32_t index = hash % capacity;
-    Entry* tombstone = NULL;
+    return hashValue(key);
+}
+
+// Returns the slot in indices that holds key. If the key is absent the returned
+// slot is where it should be inserted instead, preferring the first tombstone.
+static uint32_t findSlot(Table* table, Value key, uint32_t hash) {
+    uint32_t mask = table->capacity - 1;
+    uint32_t slot = hash & mask;
+    int64_t tombstone = -1;
 
     for (;;) {
-        Entry* entry = &entries[index];
-
-        if (entry->empty) {
-            if (IS_NIL(entry->value)) {
-                // Emtpy entry
-                return tombstone != NULL ? tombstone : entry;
-            } else {
-                // We found a tombstone
-                if (tombstone == NULL) tombstone = entry;
+        int32_t index = table->indices[slot];
+
+        if (index == INDEX_EMPTY) {
+            return tombstone != -1 ? (uint32_t)tombstone : slot;
+        } else if (index == INDEX_TOMBSTONE) {
+            if (tombstone == -1) tombstone = slot;
+        } else {
+            Entry* entry = &table->entries[index];
+            if (entry->hash == hash && valuesEqual(entry->key, key)) {
+                // We found the key
+                return slot;
             }
-        } else if (valuesEqual(entry->key, key)) {
-            // We found the key
-            return entry;
         }
 
-        index = (index + 1) % capacity;
+        slot = (slot + 1) & mask;
     }
 }
 
 bool tableGet(Table* table, Value key, Value* value) {
     if (table->count == 0) return false;
 
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    if (entry->empty) return false;
+    int32_t index = table->indices[findSlot(table, key, hashKey(key))];
+    if (index < 0) return false;
 
-    *value = entry->value;
+    *value = table->entries[index].value;
     return true;
 }
 
+// Whether storing one more new key will make the table rebuild its indices.
+bool tableIsFull(Table* table) {
+    return table->entryCount + 1 > ENTRY_CAPACITY(table->capacity);
+}
+
+// Returns the position of key in the dense entries or -1 if it is absent.
+int tableFindIndex(Table* table, Value key) {
+    if (table->count == 0) return -1;
+
+    int32_t index = table->indices[findSlot(table, key, hashKey(key))];
+    return index < 0 ? -1 : index;
+}
+
 static void adjustCapacity(Table* table, int capacity) {
-    Entry* entries = ALLOCATE(Entry, capacity);
+    // Rebuild the indices and squeeze deleted entries out of the dense array.
+    // Live entries keep their relative (insertion) order.
+    int32_t* indices = ALLOCATE(int32_t, capacity);
     for (int i = 0; i < capacity; i++) {
-        entries[i].key = NIL_VAL;
-        entries[i].value = NIL_VAL;
-        entries[i].empty = true;
+        indices[i] = INDEX_EMPTY;
     }
 
-    table->count = 0;
-    for (int i = 0; i < table->capacity; i++) {
+    int entryCapacity = ENTRY_CAPACITY(capacity);
+    Entry* entries = ALLOCATE(Entry, entryCapacity);
+
+    uint32_t mask = capacity - 1;
+    int count = 0;
+    for (int i = 0; i < table->entryCount; i++) {
         Entry* entry = &table->entries[i];
         if (entry->empty) continue;
 
-        Entry* dest = findEntry(entries, capacity, entry->key);
-        dest->key = entry->key;
-        dest->value = entry->value;
-        dest->empty = false;
-        table->count++;
+        uint32_t slot = entry->hash & mask;
+        while (indices[slot] != INDEX_EMPTY) {
+            slot = (slot + 1) & mask;
+        }
+        indices[slot] = count;
+        entries[count++] = *entry;
     }
 
-    FREE_ARRAY(Entry, table->entries, table->capacity);
+    FREE_ARRAY(int32_t, table->indices, table->capacity);
+    FREE_ARRAY(Entry, table->entries, ENTRY_CAPACITY(table->capacity));
+    table->indices = indices;
     table->entries = entries;
     table->capacity = capacity;
+    table->entryCount = count;
 }
 
 bool tableSet(Table* table, Value key, Value value) {
-    if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
-        int capacity = GROW_CAPACITY(table->capacity);
+    uint32_t hash = hashKey(key);
+
+    if (table->count > 0) {
+        uint32_t slot = findSlot(table, key, hash);
+        int32_t index = table->indices[slot];
+        if (index >= 0) {
+            table->entries[index].value = value;
+            return false;
+        }
+    }
+
+    if (table->entryCount + 1 > ENTRY_CAPACITY(table->capacity)) {
+        // Only grow when at least half of the entries are live, otherwise
+        // compacting away the deleted ones frees up enough room.
+        int capacity = table->capacity;
+        if (table->count + 1 > ENTRY_CAPACITY(capacity) / 2) {
+            capacity = GROW_CAPACITY(capacity);
+        }
         adjustCapacity(table, capacity);
     }
-    Entry* entry = findEntry(table->entries, table->capacity, key);
 
-    bool isNewKey = entry->empty;
-    if (isNewKey && IS_NIL(entry->value)) table->count++;
+    uint32_t slot = findSlot(table, key, hash);
+    int32_t index = table->entryCount++;
+    table->indices[slot] = index;
 
+    Entry* entry = &table->entries[index];
     entry->key = key;
     entry->value = value;
+    entry->hash = hash;
     entry->empty = false;
-    return isNewKey;
+    table->count++;
+    return true;
 }
 
 bool tableDelete(Table* table, Value key) {
     if (table->count == 0) return false;
 
     // Find the entry
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    if (entry->empty) return false;
+    uint32_t slot = findSlot(table, key, hashKey(key));
+    int32_t index = table->indices[slot];
+    if (index < 0) return false;
 
-    // Place a tombstone in the entry
+    // Leave a tombstone in the indices and a hole in the entries
+    table->indices[slot] = INDEX_TOMBSTONE;
+    Entry* entry = &table->entries[index];
     entry->key = NIL_VAL;
-    entry->value = BOOL_VAL(true);
+    entry->value = NIL_VAL;
     entry->empty = true;
+    table->count--;
 
     return true;
 }
 
+void tableAddAll(Table* from, Table* to) {
+    for (int i = 0; i < from->entryCount; i++) {
+        Entry* entry = &from->entries[i];
+        if (!entry->empty) {
+            tableSet(to, entry->key, entry->value);
+        }
+    }
+}
+
 ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash) {
     if (table->count == 0) return NULL;
 
-    uint32_t index = hash % table->capacity;
+    uint32_t mask = table->capacity - 1;
+    uint32_t slot = hash & mask;
 
     for (;;) {
-        Entry* entry = &table->entries[index];
-
-        if (entry->empty) {
-            // Stop if we find an empty non-tombstone entry.
-            if (IS_NIL(entry->value)) return NULL;
-        } else if (IS_STRING(entry->key) && AS_STRING(entry->key)->length == length &&
-            AS_STRING(entry->key)->hash == hash &&
-            memcmp(AS_STRING(entry->key)->chars, chars, length) == 0) {
-            // We found it.
-            return AS_STRING(entry->key);
+        int32_t index = table->indices[slot];
+
+        if (index == INDEX_EMPTY) {
+            // Stop if we find an empty non-tombstone slot.
+            return NULL;
+        } else if (index != INDEX_TOMBSTONE) {
+            Entry* entry = &table->entries[index];
+            if (entry->hash == hash && IS_STRING(entry->key) &&
+                AS_STRING(entry->key)->length == length &&
+                memcmp(AS_STRING(entry->key)->chars, chars, length) == 0) {
+                // We found it.
+                return AS_STRING(entry->key);
+            }
         }
 
-        index = (index + 1) % table->capacity;
+        slot = (slot + 1) & mask;
     }
 }
 
 void tableRemoveWhite(Table* table) {
-    // TODO unclear if this is correct
-    for (int i = 0; i < table->capacity; i++) {
+    for (int i = 0; i < table->entryCount; i++) {
         Entry* entry = &table->entries[i];
         if (!entry->empty && IS_OBJ(entry->key) && !AS_OBJ(entry->key)->isMarked) {
             tableDelete(table, entry->key);
@@ -226,8 +302,9 @@ void tableRemoveWhite(Table* table) {
 }
 
 void markTable(Table* table) {
-    for (int i = 0; i < table->capacity; i++) {
+    for (int i = 0; i < table->entryCount; i++) {
         Entry* entry = &table->entries[i];
+        if (entry->empty) continue;
         markValue(entry->key);
         markValue(entry->value);
     }
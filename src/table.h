@@ -4,23 +4,32 @@
 #include "common.h"
 #include "value.h"
 
+// Tables are compact dictionaries. Entries live densely in insertion order and
+// a separate sparse array of indices is probed to find them. Iteration only has
+// to walk the dense entries and never depends on the hash layout.
 typedef struct {
     Value key;
     Value value;
-    bool empty;
+    uint32_t hash;
+    bool empty; // Entry was deleted
 } Entry;
 
 typedef struct {
-    int count;
-    int capacity;
+    int count;          // Live entries
+    int entryCount;     // Used slots of entries, including deleted ones
+    int capacity;       // Slots in indices, always a power of two
+    int32_t* indices;
     Entry* entries;
 } Table;
 
 void initTable(Table* table);
 void freeTable(Table* table);
 bool tableGet(Table* table, Value key, Value* value);
+int tableFindIndex(Table* table, Value key);
+bool tableIsFull(Table* table);
 bool tableSet(Table* table, Value key, Value value);
 bool tableDelete(Table* table, Value key);
+void tableAddAll(Table* from, Table* to);
 ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash);
 void tableRemoveWhite(Table* table);
 void markTable(Table* table);
@@ -3,7 +3,9 @@
 
 #include "object.h"
 #include "memory.h"
+#include "output.h"
 #include "value.h"
+#include "vm.h"
 
 void initValueArray(ValueArray* array) {
     array->values = NULL;
@@ -29,10 +31,17 @@ void writeValueArray(ValueArray* array, Value value) {
 
 void printValue(Value value) {
     switch (value.type) {
-        case VAL_BOOL:   printf(AS_BOOL(value) ? "true" : "false"); break;
-        case VAL_NIL:    printf("nil"); break;
-        case VAL_NUMBER: printf("%g", AS_NUMBER(value)); break;
+        case VAL_BOOL:
+            if (AS_BOOL(value)) {
+                WRITE_LITERAL("true");
+            } else {
+                WRITE_LITERAL("false");
+            }
+            break;
+        case VAL_NIL:    WRITE_LITERAL("nil"); break;
+        case VAL_NUMBER: writeNumber(AS_NUMBER(value)); break;
         case VAL_OBJ:    printObject(value); break;
+        case VAL_EMPTY:  WRITE_LITERAL("<empty>"); break;
     }
 }
 
@@ -58,8 +67,32 @@ bool valuesEqual(Value a, Value b) {
                 }
                 return true;
             }
+            if (IS_STRING(a) && IS_STRING(b)) {
+                if (stringLength(a) != stringLength(b)) return false;
+                if (IS_ROPE(a) || IS_ROPE(b)) {
+                    // Flattening allocates so keep both alive until compared
+                    push(a);
+                    push(b);
+                    bool equal = stringsEqual(AS_STRING(a), AS_STRING(b));
+                    pop();
+                    pop();
+                    return equal;
+                }
+                return stringsEqual(AS_STRING(a), AS_STRING(b));
+            }
+            if (IS_SET(a) && IS_SET(b)) {
+                return setsEqual(AS_SET(a), AS_SET(b));
+            }
+            if (IS_BYTES(a) && IS_BYTES(b)) {
+                ObjBytes* ab = AS_BYTES(a);
+                ObjBytes* bb = AS_BYTES(b);
+                return ab->length == bb->length &&
+                       (ab->length == 0 ||
+                        memcmp(bytesData(ab), bytesData(bb), ab->length) == 0);
+            }
             return AS_OBJ(a) == AS_OBJ(b);
         }
+        case VAL_EMPTY:  return true;
     }
 
     return false;
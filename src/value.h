@@ -6,12 +6,14 @@
 // Some forward declarations to get around cyclic dependencies
 typedef struct sObj Obj;
 typedef struct sObjString ObjString;
+typedef struct sObjShape ObjShape;
 
 typedef enum {
     VAL_BOOL,
     VAL_NIL,
     VAL_NUMBER,
     VAL_OBJ, // 1st Class: String, Function, Native, List
+    VAL_EMPTY, // Internal marker for an unused slot, never seen by scripts
 } ValueType;
 
 typedef struct {
@@ -27,6 +29,7 @@ typedef struct {
 #define IS_NIL(value)     ((value).type == VAL_NIL)
 #define IS_NUMBER(value)  ((value).type == VAL_NUMBER)
 #define IS_OBJ(value)     ((value).type == VAL_OBJ)
+#define IS_EMPTY(value)   ((value).type == VAL_EMPTY)
 
 // Value -> Raw C value
 #define AS_BOOL(value)    ((value).as.boolean)
@@ -38,6 +41,7 @@ typedef struct {
 #define NIL_VAL           ((Value){ VAL_NIL, { .number = 0 } })
 #define NUMBER_VAL(value) ((Value){ VAL_NUMBER, { .number = value } })
 #define OBJ_VAL(object)   ((Value){ VAL_OBJ, { .obj = (Obj*)object } })
+#define EMPTY_VAL         ((Value){ VAL_EMPTY, { .number = 0 } })
 
 typedef struct {
     int capacity;
@@ -1,6 +1,7 @@
 #include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "common.h"
@@ -10,6 +11,7 @@
 #include "memory.h"
 #include "vm.h"
 #include "native.h"
+#include "number.h"
 
 VM vm; // TODO pass as pointer to all functions instead of being static
 
@@ -20,6 +22,9 @@ static void resetStack() {
 }
 
 static void runtimeError(const char* format, ...) {
+    // Whatever the script printed comes before the error
+    flushOutput();
+
     va_list args;
     va_start(args, format);
     vfprintf(stderr, format, args);
@@ -53,22 +58,43 @@ void initVM() {
     vm.objects = NULL;
     vm.bytesAllocated = 0;
     vm.nextGC = 1024 * 1024; // TODO tune this starting value
+    vm.openFiles = 0;
+    vm.nextFileGC = FILE_GC_MIN;
 
     vm.grayCount = 0;
     vm.grayCapacity = 0;
     vm.grayStack = NULL;
 
     vm.nextOpWide--;
+    initOutput();
+    initReader(&vm.input, 0);
 
     initTable(&vm.globals);
     initTable(&vm.strings);
 
+    vm.emptyShape = NULL;
+    vm.emptyShape = newShape(NULL, NULL);
+
+    for (int i = 0; i < UINT8_COUNT; i++) {
+        vm.characters[i] = NULL;
+    }
+    for (int i = 0; i < UINT8_COUNT; i++) {
+        char c = (char)i;
+        vm.characters[i] = copyString(&c, 1);
+    }
+
     defineNatives(&vm);
 }
 
 void freeVM() {
+    flushOutput();
+    freeReader(&vm.input);
     freeTable(&vm.globals);
     freeTable(&vm.strings);
+    vm.emptyShape = NULL;
+    for (int i = 0; i < UINT8_COUNT; i++) {
+        vm.characters[i] = NULL;
+    }
     freeObjects();
 }
 
@@ -113,10 +139,11 @@ static bool callValue(Value callee, int argCount) {
             case OBJ_NATIVE: {
                 NativeFn native = AS_NATIVE(callee);
                 Value result;
-                char errMsg[50];
+                char errMsg[NATIVE_ERROR_MAX];
                 bool err = native(argCount, vm.stackTop - argCount, &result, errMsg);
                 if (err) {
-                    runtimeError(errMsg);
+                    // An empty message means it was already reported
+                    if (errMsg[0] != '\0') runtimeError(errMsg);
                     return false;
                 }
                 vm.stackTop -= argCount + 1;
@@ -166,22 +193,241 @@ static void closeUpvalues(Value* last) {
 }
 
 static void concatenate() {
+    if (stringLength(peek(0)) + stringLength(peek(1)) >= ROPE_MIN_LENGTH) {
+        // Defer the copy so building a long string piece by piece is linear
+        ObjRope* rope = newRope(AS_OBJ(peek(1)), AS_OBJ(peek(0)));
+        pop();
+        pop();
+        push(OBJ_VAL(rope));
+        return;
+    }
+
+    // Both are shorter than any rope so they're already flat
     ObjString* b = AS_STRING(peek(0));
     ObjString* a = AS_STRING(peek(1));
 
-    int length = a->length + b->length;
-    char* chars = ALLOCATE(char, length + 1);
-    memcpy(chars, a->chars, a->length);
-    memcpy(chars + a->length, b->chars, b->length);
-    chars[length] = '\0';
-
-    ObjString* result = takeString(chars, length);
+    ObjString* result = newString(a->length + b->length);
+    memcpy(result->chars, a->chars, a->length);
+    memcpy(result->chars + a->length, b->chars, b->length);
     pop();
     pop();
     push(OBJ_VAL(result));
 }
 
-static InterpretResult run() {
+// A template string part converted to text, for the parts that aren't already
+typedef struct {
+    char chars[NUMBER_BUFFER_SIZE];
+    int length;
+} FormattedPart;
+
+// Parts up to this many format into a buffer on the C stack
+#define FORMATTED_PARTS_SMALL 16
+
+static bool buildString(int partCount) {
+    if (partCount == 1 && IS_STRING(peek(0))) return true;
+
+    // Each number is formatted once, into its part's slot, and copied from
+    // there. Flattens any ropes first, while the parts are still on the stack.
+    FormattedPart small[FORMATTED_PARTS_SMALL];
+    FormattedPart* formatted = partCount <= FORMATTED_PARTS_SMALL
+        ? small : ALLOCATE(FormattedPart, partCount);
+    int length = 0;
+    for (int i = partCount - 1; i >= 0; i--) {
+        Value part = peek(i);
+        FormattedPart* slot = &formatted[i];
+        if (IS_STRING(part)) {
+            slot->length = AS_STRING(part)->length;
+        } else if (IS_NUMBER(part)) {
+            slot->length = formatNumber(AS_NUMBER(part), slot->chars);
+        } else if (IS_BOOL(part)) {
+            slot->length = AS_BOOL(part) ? 4 : 5;
+            memcpy(slot->chars, AS_BOOL(part) ? "true" : "false", slot->length);
+        } else if (IS_NIL(part)) {
+            slot->length = 3;
+            memcpy(slot->chars, "nil", 3);
+        } else {
+            if (formatted != small) FREE_ARRAY(FormattedPart, formatted, partCount);
+            runtimeError("Template string parts must be numbers, bools, nil or strings.");
+            return false;
+        }
+        length += slot->length;
+    }
+
+    ObjString* result = newString(length);
+    char* out = result->chars;
+    for (int i = partCount - 1; i >= 0; i--) {
+        Value part = peek(i);
+        const char* chars = IS_STRING(part) ? AS_STRING(part)->chars : formatted[i].chars;
+        memcpy(out, chars, formatted[i].length);
+        out += formatted[i].length;
+    }
+    if (formatted != small) FREE_ARRAY(FormattedPart, formatted, partCount);
+
+    vm.stackTop -= partCount;
+    push(OBJ_VAL(result));
+    return true;
+}
+
+static bool indexSubscript(Value indexable, Value index, Value* result) {
+    if (IS_LIST(indexable)) {
+        ObjList* list = AS_LIST(indexable);
+        if (!IS_NUMBER(index)) {
+            runtimeError("List index is not a number.");
+            return false;
+        } else if (!isValidListIndex(list, AS_NUMBER(index))) {
+            runtimeError("List index out of range.");
+            return false;
+        }
+        *result = indexFromList(list, AS_NUMBER(index));
+    } else if (IS_STRING(indexable)) {
+        ObjString* string = AS_STRING(indexable);
+        if (!IS_NUMBER(index)) {
+            runtimeError("String index is not a number.");
+            return false;
+        } else if (!isValidStringIndex(string, AS_NUMBER(index))) {
+            runtimeError("String index out of range.");
+            return false;
+        }
+        *result = indexFromString(string, AS_NUMBER(index));
+    } else if (IS_MAPPED(indexable)) {
+        ObjMapped* mapped = AS_MAPPED(indexable);
+        if (!IS_NUMBER(index)) {
+            runtimeError("Mapped file index is not a number.");
+            return false;
+        }
+        double byte = AS_NUMBER(index);
+        // Negated so NaN fails too
+        if (!(byte >= 0 && byte < (double)mapped->length)) {
+            runtimeError("Mapped file index out of range.");
+            return false;
+        }
+        if (byte != floor(byte)) {
+            runtimeError("Mapped file index is not an integer.");
+            return false;
+        }
+        *result = OBJ_VAL(vm.characters[(uint8_t)mapped->chars[(size_t)byte]]);
+    } else if (IS_NUMBERS(indexable)) {
+        ObjNumbers* numbers = AS_NUMBERS(indexable);
+        if (!IS_NUMBER(index)) {
+            runtimeError("Number array index is not a number.");
+            return false;
+        }
+        double position = AS_NUMBER(index);
+        // Negated so NaN fails too
+        if (!(position >= 0 && position < numbers->count)) {
+            runtimeError("Number array index out of range.");
+            return false;
+        }
+        if (position != floor(position)) {
+            runtimeError("Number array index is not an integer.");
+            return false;
+        }
+        *result = NUMBER_VAL(numbers->items[(int)position]);
+    } else if (IS_BYTES(indexable)) {
+        ObjBytes* bytes = AS_BYTES(indexable);
+        if (!IS_NUMBER(index)) {
+            runtimeError("Bytes index is not a number.");
+            return false;
+        }
+        double position = AS_NUMBER(index);
+        // Negated so NaN fails too
+        if (!(position >= 0 && position < bytes->length)) {
+            runtimeError("Bytes index out of range.");
+            return false;
+        }
+        if (position != floor(position)) {
+            runtimeError("Bytes index is not an integer.");
+            return false;
+        }
+        *result = NUMBER_VAL(bytesData(bytes)[(int)position]);
+    } else if (IS_MAP(indexable)) {
+        ObjMap* map = AS_MAP(indexable);
+        if (!isHashable(index)) {
+            runtimeError("Map key is not hashable.");
+            return false;
+        }
+        if (!indexFromMap(map, index, result)) {
+            runtimeError("Key not found in map.");
+            return false;
+        }
+    } else {
+        runtimeError("Invalid type to index into.");
+        return false;
+    }
+    return true;
+}
+
+static bool storeSubscript(Value indexable, Value index, Value item) {
+    if (IS_LIST(indexable)) {
+        ObjList* list = AS_LIST(indexable);
+        if (!IS_NUMBER(index)) {
+            runtimeError("List index is not a number.");
+            return false;
+        } else if (!isValidListIndex(list, AS_NUMBER(index))) {
+            runtimeError("List index out of range.");
+            return false;
+        }
+        storeToList(list, AS_NUMBER(index), item);
+    } else if (IS_NUMBERS(indexable)) {
+        ObjNumbers* numbers = AS_NUMBERS(indexable);
+        if (!IS_NUMBER(index)) {
+            runtimeError("Number array index is not a number.");
+            return false;
+        }
+        double position = AS_NUMBER(index);
+        // Negated so NaN fails too
+        if (!(position >= 0 && position < numbers->count)) {
+            runtimeError("Number array index out of range.");
+            return false;
+        }
+        if (position != floor(position)) {
+            runtimeError("Number array index is not an integer.");
+            return false;
+        }
+        if (!IS_NUMBER(item)) {
+            runtimeError("Number array items must be numbers.");
+            return false;
+        }
+        numbers->items[(int)position] = AS_NUMBER(item);
+    } else if (IS_BYTES(indexable)) {
+        ObjBytes* bytes = AS_BYTES(indexable);
+        if (!IS_NUMBER(index)) {
+            runtimeError("Bytes index is not a number.");
+            return false;
+        }
+        double position = AS_NUMBER(index);
+        // Negated so NaN fails too
+        if (!(position >= 0 && position < bytes->length)) {
+            runtimeError("Bytes index out of range.");
+            return false;
+        }
+        if (position != floor(position)) {
+            runtimeError("Bytes index is not an integer.");
+            return false;
+        }
+        double byte = IS_NUMBER(item) ? AS_NUMBER(item) : -1;
+        if (!(byte >= 0 && byte <= 255) || byte != (int)byte) {
+            runtimeError("Bytes items must be integers from 0 to 255.");
+            return false;
+        }
+        bytesData(bytes)[(int)position] = (uint8_t)byte;
+    } else if (IS_MAP(indexable)) {
+        ObjMap* map = AS_MAP(indexable);
+        if (!isHashable(index)) {
+            runtimeError("Map key is not hashable.");
+            return false;
+        }
+        storeToMap(map, index, item);
+    } else {
+        runtimeError("Can only store subscript in list, map, number array or bytes.");
+        return false;
+    }
+    return true;
+}
+
+// Runs until the frame at baseFrame returns, leaving its result on the stack,
+// or until the script finishes when baseFrame is 0.
+static InterpretResult run(int baseFrame) {
     CallFrame* frame = &vm.frames[vm.frameCount - 1];
 
 #define READ_BYTE() (*frame->ip++)
@@ -205,10 +451,12 @@ static InterpretResult run() {
 
     for (;;) {
 #ifdef DEBUG_TRACE_EXECUTION
+        flushOutput();
         printf("          ");
         for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
             printf("[ ");
             printValue(*slot);
+            flushOutput();
             printf(" ]");
         }
         printf("\n");
@@ -461,7 +709,7 @@ static InterpretResult run() {
                     runtimeError("Map key is not hashable.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                tableSet(&map->items, key, value);
+                storeToMap(map, key, value);
             }
             pop();
 
@@ -472,75 +720,94 @@ static InterpretResult run() {
             push(OBJ_VAL(map));
             break;
         }
+        case OP_BUILD_STRING: {
+            // Before: [part1, part2, ..., partN] After: [string]
+            uint16_t partCount;
+            if (vm.nextOpWide == 1) {
+                vm.nextOpWide--;
+                partCount = READ_SHORT();
+            } else {
+                partCount = READ_BYTE();
+            }
+
+            if (!buildString(partCount)) {
+                return INTERPRET_RUNTIME_ERROR;
+            }
+            break;
+        }
         case OP_INDEX_SUBSCR: {
             // Before: [indexable, index] After: [index(indexable, index)]
-            Value index = pop();
-            Value indexable = pop();
             Value result;
-            if (IS_LIST(indexable)) {
-                ObjList* list = AS_LIST(indexable);
-                if (!IS_NUMBER(index)) {
-                    runtimeError("List index is not a number.");
-                    return INTERPRET_RUNTIME_ERROR;
-                } else if (!isValidListIndex(list, AS_NUMBER(index))) {
-                    runtimeError("List index out of range.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                result = indexFromList(list, AS_NUMBER(index));
-            } else if (IS_STRING(indexable)) {
-                ObjString* string = AS_STRING(indexable);
-                if (!IS_NUMBER(index)) {
-                    runtimeError("String index is not a number.");
-                    return INTERPRET_RUNTIME_ERROR;
-                } else if (!isValidStringIndex(string, AS_NUMBER(index))) {
-                    runtimeError("String index out of range.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                result = indexFromString(string, AS_NUMBER(index));
-            } else if (IS_MAP(indexable)) {
-                ObjMap* map = AS_MAP(indexable);
-                if (!isHashable(index)) {
-                    runtimeError("Map key is not hashable.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                bool found = tableGet(&map->items, index, &result);
-                if (!found) {
-                    runtimeError("Key not found in map.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-            } else {
-                runtimeError("Invalid type to index into.");
+            if (!indexSubscript(peek(1), peek(0), &result)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
+            pop();
+            pop();
             push(result);
             break;
         }
         case OP_STORE_SUBSCR: {
             // Before: [indexable, index, item] After: [item]
-            Value item = pop();
-            Value index = pop();
-            Value indexable = pop();
-            if (IS_LIST(indexable)) {
-                ObjList* list = AS_LIST(indexable);
-                if (!IS_NUMBER(index)) {
-                    runtimeError("List index is not a number.");
-                    return INTERPRET_RUNTIME_ERROR;
-                } else if (!isValidListIndex(list, AS_NUMBER(index))) {
-                    runtimeError("List index out of range.");
+            // Operands stay on the stack so the GC can see them while storing
+            Value item = peek(0);
+            if (!storeSubscript(peek(2), peek(1), item)) {
+                return INTERPRET_RUNTIME_ERROR;
+            }
+            vm.stackTop -= 3;
+            push(item);
+            break;
+        }
+        case OP_GET_FIELD: {
+            // Before: [indexable] After: [indexable.name]
+            InlineCache* cache = &frame->closure->function->chunk.caches[READ_SHORT()];
+            Value indexable = peek(0);
+            if (IS_MAP(indexable)) {
+                ObjMap* map = AS_MAP(indexable);
+                if (map->shape != NULL && map->shape == cache->shape) {
+                    vm.stackTop[-1] = map->items.entries[cache->index].value;
+                    break;
+                }
+
+                int index = tableFindIndex(&map->items, OBJ_VAL(cache->name));
+                if (index == -1) {
+                    runtimeError("Key not found in map.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                storeToList(list, AS_NUMBER(index), item);
-            } else if (IS_MAP(indexable)) {
+                if (map->shape != NULL) {
+                    cache->shape = map->shape;
+                    cache->index = index;
+                }
+                vm.stackTop[-1] = map->items.entries[index].value;
+                break;
+            }
+
+            Value result;
+            if (!indexSubscript(indexable, OBJ_VAL(cache->name), &result)) {
+                return INTERPRET_RUNTIME_ERROR;
+            }
+            vm.stackTop[-1] = result;
+            break;
+        }
+        case OP_SET_FIELD: {
+            // Before: [indexable, item] After: [item]
+            InlineCache* cache = &frame->closure->function->chunk.caches[READ_SHORT()];
+            Value item = peek(0);
+            Value indexable = peek(1);
+            if (IS_MAP(indexable)) {
                 ObjMap* map = AS_MAP(indexable);
-                if (!isHashable(index)) {
-                    runtimeError("Map key is not hashable.");
-                    return INTERPRET_RUNTIME_ERROR;
+                if (map->shape != NULL && map->shape == cache->shape) {
+                    map->items.entries[cache->index].value = item;
+                } else {
+                    storeToMap(map, OBJ_VAL(cache->name), item);
+                    if (map->shape != NULL) {
+                        cache->shape = map->shape;
+                        cache->index = tableFindIndex(&map->items, OBJ_VAL(cache->name));
+                    }
                 }
-                tableSet(&map->items, index, item);
-            } else {
-                runtimeError("Can only store subscript in list or map.");
+            } else if (!storeSubscript(indexable, OBJ_VAL(cache->name), item)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
+            vm.stackTop -= 2;
             push(item);
             break;
         }
@@ -557,6 +824,7 @@ static InterpretResult run() {
 
             vm.stackTop = frame->slots;
             push(result);
+            if (vm.frameCount == baseFrame) return INTERPRET_OK;
 
             frame = &vm.frames[vm.frameCount - 1];
             break;
@@ -588,5 +856,16 @@ InterpretResult interpret(const char* source) {
     push(OBJ_VAL(closure));
     callValue(OBJ_VAL(closure), 0);
 
-    return run();
-}
\ No newline at end of file
+    InterpretResult result = run(0);
+    flushOutput();
+    return result;
+}
+
+bool callFromNative(int argCount, Value* result) {
+    int baseFrame = vm.frameCount;
+    if (!callValue(peek(argCount), argCount)) return false;
+    // Natives have already finished; closures run until they return
+    if (vm.frameCount > baseFrame && run(baseFrame) != INTERPRET_OK) return false;
+    *result = pop();
+    return true;
+}
@@ -2,6 +2,7 @@
 #define nqq_vm_h
 
 #include "object.h"
+#include "output.h"
 #include "table.h"
 #include "value.h"
 
@@ -28,12 +29,23 @@ typedef struct {
     Value* stackTop;
     Table globals;
     Table strings;
+    ObjShape* emptyShape;
+    ObjString* characters[UINT8_COUNT]; // Every single byte string
     ObjUpvalue* openUpvalues;
 
     uint8_t nextOpWide;
 
+    char output[OUTPUT_BUFFER_SIZE]; // Script output not yet given to stdout
+    int outputCount;
+    bool lineBuffered;  // Flush after every line, for terminals
+    Reader input;       // Standard input
+
     size_t bytesAllocated;
     size_t nextGC;
+    // Files hold descriptors the heap size doesn't reflect, so opening enough
+    // of them triggers a collection too
+    int openFiles;
+    int nextFileGC;
 
     Obj* objects;
     int grayCount;
@@ -55,5 +67,10 @@ InterpretResult interpret(const char* source);
 void push(Value value);
 Value pop();
 bool isFalsey(Value value);
+// Calls the function below argCount arguments on top of the stack, for a
+// native, and pops them all off again. On a runtime error the error has been
+// reported and the stack unwound, and the native should return with an empty
+// errMsg.
+bool callFromNative(int argCount, Value* result);
 
 #endif